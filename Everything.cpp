@@ -68,6 +68,8 @@ namespace mem
 	}
 
 	WeakObject Everything::make() {
+		this->materialize();
+
 		if (!this->freeIndirections.empty()) {
 			auto i = this->freeIndirections.back();
 			this->freeIndirections.pop_back();
@@ -80,8 +82,11 @@ namespace mem
 		}
 		else {
 			this->signatures.push_back(0);
+
+			// Tables of types registered at runtime can be shorter, resize
+			// brings them up to the other ones.
 			for (size_t type = 0; type < this->getTypeCount(); type++) {
-				this->dataIndices[type].push_back(Index<RawData>{ 0 });
+				this->dataIndices[type].resize(this->signatures.size(), Index<RawData>{ 0 });
 			}
 
 			this->qualifiers.push_back(this->getNextQualifier());
@@ -99,6 +104,69 @@ namespace mem
 		return this->make();
 	}
 
+	Index<Everything> Everything::reserve() {
+		Index<Everything> res{ 0 };
+		this->reserve(std::span(&res, 1));
+		return res;
+	}
+
+	void Everything::reserve(std::span<Index<Everything>> out) {
+		const size_t freeCount = this->freeIndirections.size();
+		const size_t first = this->reservedFree.value.fetch_add(out.size());
+
+		size_t k = 0;
+		for (; k < out.size() && first + k < freeCount; k++) {
+			out[k] = this->freeIndirections[freeCount - 1 - first - k];
+		}
+
+		if (k == out.size()) {
+			return;
+		}
+
+		const size_t fresh = this->reservedFresh.value.fetch_add(out.size() - k);
+		for (size_t j = 0; k < out.size(); k++, j++) {
+			out[k].set(this->signatures.size() + fresh + j);
+		}
+	}
+
+	void Everything::materialize() {
+		const size_t taken = std::min(this->reservedFree.value.exchange(0), this->freeIndirections.size());
+		const size_t fresh = this->reservedFresh.value.exchange(0);
+
+		for (size_t k = 0; k < taken; k++) {
+			auto i = this->freeIndirections.back();
+			this->freeIndirections.pop_back();
+
+			tassert(this->signatures[i].none());
+			this->validIndices[i] = true;
+		}
+
+		if (fresh == 0) {
+			return;
+		}
+
+		const size_t size = this->signatures.size() + fresh;
+
+		this->signatures.resize(size, 0);
+		for (size_t type = 0; type < this->getTypeCount(); type++) {
+			this->dataIndices[type].resize(size, Index<RawData>{ 0 });
+		}
+
+		this->qualifiers.reserve(size);
+		while (this->qualifiers.size() < size) {
+			this->qualifiers.push_back(this->getNextQualifier());
+		}
+
+		this->validIndices.resize(size, true);
+
+		const size_t words = (size + 63) / 64;
+		for (auto& bitmap : this->presence) {
+			if (!bitmap.empty() && bitmap.size() < words) {
+				bitmap.resize(words, 0);
+			}
+		}
+	}
+
 	UniqueObject Everything::cloneAll(WeakObject const& obj) {
 		std::vector<Index<Component>> all;
 
@@ -113,17 +181,253 @@ namespace mem
 		tassert(0);
 		auto p = this->makeUnique();
 		for (auto& type : components) {
-			if (obj.has(type)) {
-				auto componentIndex = obj.getComponentIndex(type);
-				auto newComponentIndex = this->data[type].cloneUntyped(componentIndex, p.index);
+			if (!obj.has(type)) {
+				continue;
+			}
 
-				this->dataIndices[type][p.index] = newComponentIndex;
-				this->signatures[p.index].set(type);
+			switch (this->getStorage(type)) {
+				case Storage::pool:
+				case Storage::split:
+				{
+					auto componentIndex = obj.getComponentIndex(type);
+					auto newComponentIndex = this->data[type].cloneUntyped(componentIndex, p.index);
+
+					this->dataIndices[type][p.index] = newComponentIndex;
+					break;
+				}
+				case Storage::dense:
+					this->data[type].cloneAtUntyped(Index<RawData>{ obj.index.i }, p.index);
+					this->dataIndices[type][p.index] = Index<RawData>{ p.index.i };
+					break;
+				case Storage::shared:
+				{
+					auto componentIndex = obj.getComponentIndex(type);
+					this->data[type].acquireShared(componentIndex);
+
+					this->dataIndices[type][p.index] = componentIndex;
+					break;
+				}
+				case Storage::tag:
+					break;
 			}
+
+			this->signatures[p.index].set(type);
+			this->setPresence(p.index, type);
+		}
+
+		for (Index<OwningGroup> group{ 1 }; group < this->groups.size(); group++) {
+			this->enterGroup(group, p.index);
 		}
+
 		return p;
 	}
 
+	Index<Everything> Everything::moveEntity(Everything& from, Everything& to, Index<Everything> i, bool forward) {
+		auto j = to.make().index;
+		Everything::relocate(from, to, i, j, forward);
+		return j;
+	}
+
+	void Everything::moveEntities(Everything& from, Everything& to, std::span<Index<Everything> const> indices, std::span<Index<Everything>> out, bool forward) {
+		tassert(indices.size() == out.size());
+
+		to.reserve(out);
+		to.materialize();
+
+		for (size_t k = 0; k < indices.size(); k++) {
+			Everything::relocate(from, to, indices[k], out[k], forward);
+		}
+	}
+
+	void Everything::relocate(Everything& from, Everything& to, Index<Everything> i, Index<Everything> j, bool forward) {
+		tassert(&from != &to);
+		tassert(from.isValidIndex(i));
+		tassert(to.isValidIndex(j));
+		tassert(to.signatures[j].none());
+
+		// Slots only move within their pool while leaving a group, after this
+		// the slots of i stay put until they are taken.
+		for (Index<OwningGroup> group{ 1 }; group < from.groups.size(); group++) {
+			from.leaveGroup(group, i);
+		}
+
+		for (Index<Component> type{ 0 }; type < from.getTypeCount(); type++) {
+			if (!from.has(i, type)) {
+				continue;
+			}
+
+			auto& source = from.data[type];
+			auto& target = to.data[type];
+
+			// A type registered at runtime after j was made has no entry for it.
+			if (to.dataIndices[type].size() < to.signatures.size()) {
+				to.dataIndices[type].resize(to.signatures.size(), Index<RawData>{ 0 });
+			}
+
+			switch (from.getStorage(type)) {
+				case Storage::pool:
+				case Storage::split:
+					to.dataIndices[type][j] = target.relocateUntyped(source, from.dataIndices[type][i], j);
+					break;
+				case Storage::dense:
+					target.relocateAtUntyped(source, Index<RawData>{ i.i }, j);
+					to.dataIndices[type][j] = Index<RawData>{ j.i };
+					break;
+				case Storage::shared:
+				{
+					auto slot = from.dataIndices[type][i];
+					to.dataIndices[type][j] = target.internUntyped(source.getUntyped(slot), source.structInformation);
+					source.releaseShared(slot);
+					break;
+				}
+				case Storage::tag:
+					break;
+			}
+
+			to.signatures[j].set(type);
+			to.setPresence(j, type);
+
+			from.signatures[i].reset(type);
+			from.resetPresence(i, type);
+		}
+
+		for (Index<OwningGroup> group{ 1 }; group < to.groups.size(); group++) {
+			to.enterGroup(group, j);
+		}
+
+		if (forward) {
+			from.forwardings[i] = { from.qualifiers[i], { j, &to }, to.qualifiers[j] };
+		}
+
+		// Nothing is left to destroy, this only retires the index.
+		from.remove(i);
+	}
+
+	IndexConverter<Everything, Everything> Everything::merge(Everything&& other) {
+		tassert(&other != this);
+
+		this->materialize();
+		other.collectRemoved();
+
+		IndexConverter<Everything, Everything> res{};
+		res.resize(other.signatures.size());
+
+		Index<Everything> next{ this->signatures.size() };
+		for (Index<Everything> i{ 1 }; i < other.signatures.size(); i++) {
+			if (other.validIndices[i]) {
+				res.set(i, next++);
+			}
+		}
+
+		this->reservedFresh.value += next - this->signatures.size();
+		this->materialize();
+
+		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+			auto storage = this->getStorage(type);
+			if (storage != Storage::pool && storage != Storage::split) {
+				continue;
+			}
+
+			auto& target = this->data[type];
+			for (auto slot = target.append(other.data[type], res); slot < target.index; slot++) {
+				this->dataIndices[type][target.getIndex(slot)] = slot;
+			}
+		}
+
+		// Shared slots of other that were interned already.
+		std::vector<std::vector<Index<RawData>>> interned(this->getTypeCount());
+
+		for (Index<Everything> i{ 1 }; i < other.signatures.size(); i++) {
+			auto j = res(i);
+			if (j == 0) {
+				continue;
+			}
+
+			for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+				if (!other.has(i, type)) {
+					continue;
+				}
+
+				switch (this->getStorage(type)) {
+					case Storage::dense:
+						this->data[type].relocateAtUntyped(other.data[type], Index<RawData>{ i.i }, j);
+						this->dataIndices[type][j] = Index<RawData>{ j.i };
+						break;
+					case Storage::shared:
+					{
+						auto& source = other.data[type];
+						auto& slots = interned[type];
+						slots.resize(source.index, Index<RawData>{ 0 });
+
+						auto slot = other.dataIndices[type][i];
+						if (slots[slot] == 0) {
+							slots[slot] = this->data[type].internUntyped(source.getUntyped(slot), source.structInformation);
+						}
+						else {
+							this->data[type].acquireShared(slots[slot]);
+						}
+
+						this->dataIndices[type][j] = slots[slot];
+						break;
+					}
+					case Storage::pool:
+					case Storage::split:
+					case Storage::tag:
+						break;
+				}
+
+				this->setPresence(j, type);
+			}
+
+			this->signatures[j] = other.signatures[i];
+
+			for (Index<OwningGroup> group{ 1 }; group < this->groups.size(); group++) {
+				this->enterGroup(group, j);
+			}
+		}
+
+		// Parents come first, so every node is appended to a level below its
+		// parent.
+		for (auto const& level : other.hierarchy.levels) {
+			for (auto const& node : level) {
+				this->hierarchy.setParent(res(node.entity), res(node.parent));
+			}
+		}
+
+		for (auto& [id, pool] : other.relations) {
+			auto& target = this->relations[id];
+			for (auto const& [source, destination] : pool.forward) {
+				target.insert(res(source), res(destination));
+			}
+		}
+
+		// Only the shared values are left to destroy.
+		other = Everything();
+
+		return res;
+	}
+
+	std::optional<WeakObject> Everything::getForwarded(Index<Everything> i, Qualifier q) const {
+		std::optional<WeakObject> res{};
+		Everything const* world = this;
+
+		while (true) {
+			auto it = world->forwardings.find(i);
+			if (it == world->forwardings.end() || it->second.qualifier != q) {
+				return res;
+			}
+
+			res = it->second.target;
+			i = res->index;
+			q = it->second.targetQualifier;
+			world = res->proxy;
+		}
+	}
+
+	void Everything::clearForwarded() {
+		this->forwardings.clear();
+	}
+
 	std::optional<WeakObject> Everything::maybeGetFromIndex(Index<Everything> index) {
 		if (this->isValidIndex(index)) {
 			return this->getFromIndex(index);
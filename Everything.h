@@ -4,42 +4,232 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <bitset>
 #include <array>
 #include <optional>
 #include <algorithm>
+#include <span>
+#include <bit>
+#include <numeric>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <memory>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
 
 #include <tepp/tepp.h>
 #include <tepp/optional_ref.h>
 
+#include "Macros.h"
 #include "Global.h"
 #include "LazyGlobal.h"
 #include "Index.h"
 
+// The widths of entity and pool indices can be narrowed at compile time, e.g.
+// -DMEM_ENTITY_INDEX_TYPE=uint32_t -DMEM_POOL_INDEX_TYPE=uint32_t, which halves
+// the size of signatures-adjacent tables like dataIndices and RawData::indices.
+#ifndef MEM_ENTITY_INDEX_TYPE
+#define MEM_ENTITY_INDEX_TYPE size_t
+#endif
+
+#ifndef MEM_POOL_INDEX_TYPE
+#define MEM_POOL_INDEX_TYPE size_t
+#endif
+
 struct Component;
 
 template<class T>
 struct Identifier;
 
-#define DEFAULT_COPY(T) T(const T&) = default; T& operator=(const T&) = default;
-#define NO_COPY(T) T(const T&) = delete; T& operator=(const T&) = delete;
-#define DEFAULT_MOVE(T) T(T&&) = default; T& operator=(T&&) = default;
-#define NO_MOVE(T) T(T&&) = delete; T& operator=(T&&) = delete;
-#define DEFAULT_COPY_MOVE(T) DEFAULT_COPY(T) DEFAULT_MOVE(T)
-#define NO_COPY_MOVE(T) NO_COPY(T) NO_MOVE(T)
+// Hint to pull the cache line holding ptr ahead of its use.
+#if defined(__GNUC__) || defined(__clang__)
+#define MEM_PREFETCH(ptr) __builtin_prefetch(ptr)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define MEM_PREFETCH(ptr) _mm_prefetch(reinterpret_cast<char const*>(ptr), _MM_HINT_T0)
+#else
+#define MEM_PREFETCH(ptr) ((void)(ptr))
+#endif
+
+namespace mem
+{
+	using entity_index_type = MEM_ENTITY_INDEX_TYPE;
+	using pool_index_type = MEM_POOL_INDEX_TYPE;
+
+	struct Everything;
+	struct RawData;
+}
+
+template<>
+struct default_index_type_of<mem::Everything>
+{
+	using type = mem::entity_index_type;
+};
+
+template<>
+struct default_index_type_of<mem::RawData>
+{
+	using type = mem::pool_index_type;
+};
 
 namespace mem
 {
+	constexpr size_t SIZE = 64;
+	using SignatureType = std::bitset<SIZE>;
+	using Qualifier = size_t;
+
+	enum class Storage
+	{
+		// Components live in a packed RawData pool, reached through dataIndices.
+		pool,
+		// Empty components, only stored as a bit in the signature.
+		tag,
+		// Components stored directly at the slot equal to the entity index,
+		// presence is only kept in the signature.
+		dense,
+		// Interned, reference counted values shared between all entities with
+		// an equal component. Shared components can only be read through get,
+		// changing one means replacing it.
+		shared,
+		// Every field listed in component_fields<T> lives in its own array in the
+		// pool. Whole components are read and written by value, single fields in
+		// place through field, fieldSpan and matchFields.
+		split,
+	};
+
+	template<class T>
+	struct storage_policy
+	{
+		static constexpr Storage value = std::is_empty_v<T> ? Storage::tag : Storage::pool;
+	};
+
+	template<class T>
+	constexpr Storage storage_policy_v = storage_policy<T>::value;
+
+	// Specialize to keep a second copy of a pooled component that holds its
+	// value at the last swapBuffers. Match arguments taking T const& read that
+	// copy, so systems can read the previous state while others write T&.
+	template<class T>
+	struct double_buffered
+	{
+		static constexpr bool value = false;
+	};
+
+	template<class T>
+	constexpr bool double_buffered_v = double_buffered<T>::value;
+
+	template<class T>
+	using component_reference_t = std::conditional_t<
+		storage_policy_v<T> == Storage::shared,
+		T const&,
+		std::conditional_t<storage_policy_v<T> == Storage::split, T, T&>
+	>;
+
+	// Fields of a component with split storage, specialize with
+	// static constexpr std::tuple value{ &T::a, &T::b };
+	template<class T>
+	struct component_fields;
+
+	template<class M>
+	struct member_pointer_traits;
+
+	template<class C, class M>
+	struct member_pointer_traits<M C::*>
+	{
+		using class_type = C;
+		using value_type = M;
+	};
+
+	template<auto member>
+	using member_class_t = typename member_pointer_traits<decltype(member)>::class_type;
+
+	template<auto member>
+	using member_value_t = typename member_pointer_traits<decltype(member)>::value_type;
+
+	template<class T>
+	constexpr size_t field_count_v = std::tuple_size_v<std::remove_cvref_t<decltype(component_fields<T>::value)>>;
+
+	// Position of member in component_fields of its class.
+	template<auto member>
+	constexpr size_t field_index_v = [] {
+		using T = member_class_t<member>;
+
+		size_t res = field_count_v<T>;
+		[&]<size_t... Is>(std::index_sequence<Is...>) {
+			([&] {
+				constexpr auto other = std::get<Is>(component_fields<T>::value);
+				if constexpr (std::same_as<std::remove_const_t<decltype(other)>, decltype(member)>) {
+					if (other == member) {
+						res = Is;
+					}
+				}
+			}(), ...);
+		}(std::make_index_sequence<field_count_v<T>>{});
+
+		return res;
+	}();
+
+	struct ComponentField
+	{
+		std::string name{};
+		size_t offset = 0;
+		size_t size = 0;
+	};
+
+	// Layout of a component type that is only known at runtime, registered
+	// with Everything::registerComponent.
+	struct ComponentDescriptor
+	{
+		std::string name{};
+		size_t size = 0;
+		size_t alignment = 1;
+		Storage storage = Storage::pool;
+		std::vector<ComponentField> fields{};
+
+		// Null callbacks make a trivial type: new objects are copies of
+		// defaultValue (zeroed if it is empty), copies are memcpy and
+		// destruction does nothing. With LIB_SERIAL components are saved as
+		// their bytes, which needs a null copy.
+		void(*construct)(void* target) = nullptr;
+		void(*destruct)(void*) = nullptr;
+		void(*copy)(void* source, void* target) = nullptr;
+		std::vector<std::byte> defaultValue{};
+	};
+
 	struct StructInformation
 	{
 		std::string name{};
 		Index<Component> index{};
 		size_t width{};
+		Storage storage = Storage::pool;
 
 		void(*clone)(void* source, void* target) = nullptr;
 		void(*objectDestructor)(void*) = nullptr;
 
+		// Split storage, the width of every field array and copying a whole
+		// component out of and into a slot.
+		std::vector<size_t> columnWidths{};
+		void(*load)(RawData& pool, Index<RawData> i, void* target) = nullptr;
+		void(*store)(RawData& pool, Index<RawData> i, void const* source) = nullptr;
+
+		// Pool storage with a front buffer, see double_buffered.
+		bool buffered = false;
+
+		// Only set for types registered from a ComponentDescriptor.
+		bool trivialCopy = false;
+		void(*construct)(void* target) = nullptr;
+		std::vector<std::byte> defaultValue{};
+		std::vector<ComponentField> fields{};
+
+		size_t(*hash)(void*) = nullptr;
+		bool(*equal)(void*, void*) = nullptr;
+
 #ifdef LIB_SERIAL
 		bool(*objectReader)(serial::Serializer& serializer, void*) = nullptr;
 		bool(*objectWriter)(serial::Serializer& serializer, void*) = nullptr;
@@ -54,18 +244,12 @@ namespace mem
 #else
 		std::unordered_map<size_t, StructInformation> infos{};
 #endif
+		std::array<StructInformation, SIZE> indexed{};
 
 		template<class T>
 		StructInformation get();
 	};
 
-
-	constexpr size_t SIZE = 64;
-	using SignatureType = std::bitset<SIZE>;
-	using Qualifier = size_t;
-
-	struct Everything;
-
 	struct RawData
 	{
 		template<class T>
@@ -94,6 +278,34 @@ namespace mem
 
 		std::vector<Index<RawData>> deletions{};
 
+		// Whether the live slots are in increasing entity order.
+		bool sorted = true;
+
+		struct Column
+		{
+			size_t width = 0;
+			std::vector<std::byte> data{};
+		};
+
+		// Double buffered pools, data is written and front keeps the objects as
+		// they were at the last swapBuffers. dirty is set for slots written
+		// since, it moves with the objects like another column.
+		std::vector<std::byte> front{};
+		std::vector<std::byte> dirty{};
+		// At least the number of set flags, flags of removed slots can be
+		// overwritten without counting down.
+		size_t dirtyCount = 0;
+
+		// Split storage, field k of slot i is at columns[k].data[i * width], data
+		// stays empty.
+		std::vector<Column> columns{};
+
+		// Shared storage, reference counts per slot (0 for free slots) and the
+		// interned values by hash.
+		std::vector<size_t> references{};
+		std::vector<Index<RawData>> freeSlots{};
+		std::unordered_multimap<size_t, Index<RawData>> sharedLookup{};
+
 		struct DeletedInfo
 		{
 			Index<RawData> i;
@@ -113,6 +325,9 @@ namespace mem
 
 		inline void removeUntyped(Index<RawData> i);
 
+		// Dense storage, slot i holds the component of entity i.
+		inline void removeAtUntyped(Index<RawData> i);
+
 		template<class T>
 		inline T& get(Index<RawData> i);
 
@@ -120,18 +335,120 @@ namespace mem
 
 		inline Index<Everything> getIndex(Index<RawData> i) const;
 
+		inline bool isAlive(Index<RawData> i) const;
+
+		// Keeps the sorted flag up to date for an entity appended at the back.
+		inline void appendIndex(Index<Everything> i);
+
+		// First slot at or after from whose entity is not below target, requires
+		// a sorted pool. Slots removed since the last packDeletions are skipped.
+		inline Index<RawData> gallop(Index<RawData> from, Index<Everything> target) const;
+
 #ifdef LIB_SERIAL
 		bool print(serial::Serializer& serializer, Index<RawData> i);
+
+		// Through the callbacks of the type, components registered at runtime
+		// have none and go as their width in bytes.
+		inline bool readObject(serial::Serializer& serializer, void* obj);
+		inline bool writeObject(serial::Serializer& serializer, void* obj);
+		inline bool printObject(serial::Serializer& serializer, void* obj);
 #endif
 
 		template<class T, class... Args>
 		[[nodiscard]]
 		inline std::pair<Index<RawData>, T*> add(Index<Everything> i, Args&&... args);
 
+		template<class T, class... Args>
+		inline T* addAt(Index<Everything> i, Args&&... args);
+
 		[[nodiscard]]
 		inline Index<RawData> cloneUntyped(Index<RawData> i, Index<Everything> j);
 
+		inline void swap(Index<RawData> i, Index<RawData> j);
+
+		// Moves the object in slot order[k] to slot k, following the cycles of
+		// the permutation with a single object of scratch space.
+		inline void permute(std::vector<Index<RawData>> const& order);
+
+		inline void cloneAtUntyped(Index<RawData> i, Index<Everything> j);
+
+		// Copies through structInformation.clone, or memcpy for trivial types.
+		inline void copyUntyped(void* source, void* target);
+
+		// Moves the object in slot i of source to a new slot for entity j with
+		// memcpy, leaving slot i of source dead without running its destructor.
+		[[nodiscard]]
+		inline Index<RawData> relocateUntyped(RawData& source, Index<RawData> i, Index<Everything> j);
+
+		// Dense storage, moves the object of entity i in source to slot j.
+		inline void relocateAtUntyped(RawData& source, Index<RawData> i, Index<Everything> j);
+
+		// Shared storage, interns a copy of the object at value.
+		[[nodiscard]]
+		inline Index<RawData> internUntyped(void* value, StructInformation const& info);
+
+		// Moves every object of source to the back of this pool with a memcpy per
+		// array, renaming their entities through remap. source is left empty
+		// without running destructors. Returns the slot of the first object.
+		inline Index<RawData> append(RawData& source, IndexConverter<Everything, Everything> const& remap);
+
+		// Calls f(std::vector<std::byte>& bytes, size_t width) for the array of
+		// whole objects, or for every field array of split storage. Double
+		// buffered pools also have the front buffer and the dirty flags.
+		template<class F>
+		inline void forColumns(F f);
+
+		// Calls f(bytes, otherBytes, width) for every pair of the same arrays of
+		// this pool and other, a pool of the same type.
+		template<class F>
+		inline void forColumns(RawData& other, F f);
+
+		// Double buffered storage.
+		inline void markDirty(Index<RawData> i);
+		// Copies the object in slot i to the front buffer.
+		inline void mirror(Index<RawData> i);
+		inline void* getFrontUntyped(Index<RawData> i);
+		// Swaps the buffers in O(1), then brings the new back buffer up to date
+		// by copying only the dirty slots.
+		inline void swapBuffers();
+
+		inline std::byte* getField(size_t field, Index<RawData> i);
+
+		template<auto member>
+		inline member_value_t<member>& field(Index<RawData> i);
+
+		// Split storage, a copy of the component put together from its fields.
+		template<class T>
+		inline T load(Index<RawData> i);
+
+		template<class T>
+		inline void store(Index<RawData> i, T const& value);
+
+		template<class T, class... Args>
+		[[nodiscard]]
+		inline Index<RawData> addSplit(Index<Everything> i, Args&&... args);
+
+		// Constructs a new object of a type registered at runtime at target.
+		inline void constructUntyped(void* target);
+
+		inline void initialize(StructInformation const& info);
+
+		[[nodiscard]]
+		inline std::pair<Index<RawData>, void*> addUntyped(Index<Everything> i, StructInformation const& info);
+
+		inline void* addAtUntyped(Index<Everything> i, StructInformation const& info);
+
+		template<class T, class... Args>
+		[[nodiscard]]
+		inline Index<RawData> addShared(Args&&... args);
+
+		inline void acquireShared(Index<RawData> i);
+		inline void releaseShared(Index<RawData> i);
+
 		void increaseSize();
+
+		// Grows the arrays by doubling until objects fit.
+		inline void reserve(size_t objects);
 	};
 
 	struct WeakObject
@@ -152,22 +469,22 @@ namespace mem
 		inline void remove();
 
 		template<class T>
-		inline te::optional_ref<T> getMaybe();
+		inline te::optional_ref<std::remove_reference_t<component_reference_t<T>>> getMaybe();
 
 		template<class T>
-		inline T& get();
+		inline component_reference_t<T> get();
 
 		template<class T, class... Args>
-		inline T& add(Args&&... args);
+		inline component_reference_t<T> add(Args&&... args);
 
 		template<class T, class... Args>
-		inline T& addOrGet(Args&&... args);
+		inline component_reference_t<T> addOrGet(Args&&... args);
 
 		template<class T, class... Args>
-		inline T& addOrReplace(Args&&... args);
+		inline component_reference_t<T> addOrReplace(Args&&... args);
 
 		template<class T, class... Args>
-		inline T& tryAdd(Args&&... args);
+		inline component_reference_t<T> tryAdd(Args&&... args);
 
 		template<class... Ts>
 		inline bool has() const;
@@ -220,601 +537,4274 @@ namespace mem
 		DEFAULT_COPY_MOVE(QualifiedObject);
 	};
 
-	struct NewEverything
+	// Query terms that can be taken as match arguments next to components.
+	template<class T>
+	struct Without
 	{
-		Everything* ptr = nullptr;
+	};
 
-		NewEverything(Everything* p) : ptr(p) {};
-		NewEverything() = default;
-		~NewEverything() = default;
+	template<class... Ts>
+	struct AnyOf
+	{
 	};
 
-	struct Everything
+	// A double buffered component as it was at the last swapBuffers, the term
+	// match uses for T const& arguments of such components.
+	template<class T>
+	struct Previous
 	{
-		struct ComponentCounter
-		{
-			size_t t = 0;
+	};
 
-			Index<Component> increment() {
-				return { t++ };
-			}
+	template<class Arg>
+	struct query_term
+	{
+		using type = std::conditional_t<
+			std::is_const_v<std::remove_reference_t<Arg>> && double_buffered_v<std::remove_cvref_t<Arg>>,
+			Previous<std::remove_cvref_t<Arg>>,
+			std::remove_cvref_t<Arg>
+		>;
+	};
 
-			size_t size() {
-				return t;
-			}
-		};
+	template<class Arg>
+	using query_term_t = typename query_term<Arg>::type;
 
-		template<class T>
-		struct ComponentIndex
-		{
-			Index<Component> val = LazyGlobal<ComponentCounter>->increment();
-		};
+	template<class T>
+	struct Optional
+	{
+		std::remove_reference_t<component_reference_t<T>>* ptr = nullptr;
 
-		template<class T>
-		struct component_index
-		{
-			static inline Index<Component> getVal() {
-				tassert(LazyGlobal<ComponentCounter>->size() < SIZE);
+		auto* get() const {
+			return this->ptr;
+		}
 
-				StructInformation info;
-#ifdef LIB_SERIAL
-				static_assert(serial::has_type_name<T>);
-				info.name = serial::Serializable<T>::typeName;
-#endif
-				info.index = LazyGlobal<ComponentIndex<T>>->val;
-				info.width = RawData::aligned_sizeof<T>::get();
-				info.objectDestructor = [](void* obj) {
-					reinterpret_cast<T*>(obj)->~T();
-				};
+		auto* operator->() const {
+			return this->ptr;
+		}
 
-#ifdef LIB_SERIAL
-				info.objectReader = [](serial::Serializer& serializer, void* obj) {
-					return serializer.read<T>(std::forward<T>(*reinterpret_cast<T*>(obj)));
-				};
+		auto& operator*() const {
+			return *this->ptr;
+		}
 
-				info.objectWriter = [](serial::Serializer& serializer, void* obj) {
-					return serializer.write<T>(std::forward<T>(*reinterpret_cast<T*>(obj)));
-				};
+		explicit operator bool() const {
+			return this->ptr != nullptr;
+		}
+	};
 
-				info.objectPrinter = [](serial::Serializer& serializer, void* obj) {
-					return serializer.print<T>(std::forward<T>(*reinterpret_cast<T*>(obj)));
-				};
-#endif
+	struct QueryFilter
+	{
+		SignatureType with{};
+		SignatureType without{};
+		// with | without, a signature passes if masking it gives with.
+		SignatureType mask{};
+		// At least one component of each has to be present.
+		std::vector<SignatureType> anyOf{};
+
+		inline bool test(SignatureType const& signature) const {
+			if ((signature & this->mask) != this->with) {
+				return false;
+			}
 
-				if constexpr (std::copy_constructible<T>) {
-					info.clone = [](void* source, void* target) {
-						new (target) T(*reinterpret_cast<T*>(source));
-					};
+			for (auto const& any : this->anyOf) {
+				if ((signature & any).none()) {
+					return false;
 				}
+			}
 
-#ifdef LIB_SERIAL
-				LazyGlobal<StoredStructInformations>->infos.insert({ info.name, info });
-#else
-				LazyGlobal<StoredStructInformations>->infos.insert({ info.index, info });
-#endif
+			return true;
+		}
+	};
 
-				return info.index;
-			};
+	// std::atomic that can be moved together with its owner, the move itself is
+	// not atomic.
+	template<class T>
+	struct MovableAtomic
+	{
+		std::atomic<T> value;
 
-			static inline Index<Component> val = getVal();
-		};
+		MovableAtomic(T value_ = {}) : value(value_) {
+		}
 
-		template<class T>
-		static inline Index<Component> component_index_v = component_index<T>::val;
+		MovableAtomic(MovableAtomic&& other) noexcept : value(other.value.load()) {
+		}
 
-		template<class M, class... Ms>
-		struct group_signature
-		{
-			static const inline SignatureType fillSignature() {
-				SignatureType res{};
-				if constexpr (sizeof...(Ms) == 0) {
-					res.set(LazyGlobal<ComponentIndex<M>>->val);
-				}
-				else {
-					for (auto s : { LazyGlobal<ComponentIndex<M>>->val, LazyGlobal<ComponentIndex<Ms>>->val... }) {
-						res.set(s);
-					}
-				}
-				return res;
-			};
+		MovableAtomic& operator=(MovableAtomic&& other) noexcept {
+			this->value.store(other.value.load());
+			return *this;
+		}
 
-			static const inline SignatureType value = fillSignature();
-		};
+		MovableAtomic(MovableAtomic const& other) : value(other.value.load()) {
+		}
 
-		template<class... Ms>
-		static inline const SignatureType group_signature_v = group_signature<Ms...>::value;
+		MovableAtomic& operator=(MovableAtomic const& other) {
+			this->value.store(other.value.load());
+			return *this;
+		}
 
+		~MovableAtomic() = default;
+	};
 
-		std::vector<Index<Everything>> freeIndirections{};
+	// std::shared_mutex that can be moved together with its owner, the owner
+	// gets a new unlocked mutex. It must not be held during the move.
+	struct MovableMutex
+	{
+		std::shared_mutex mutex{};
 
-		std::vector<Qualifier> qualifiers{ 0 };
-		std::vector<int32_t> validIndices{ false };
-		Qualifier qualifier = 1;
+		MovableMutex() = default;
 
-		std::vector<SignatureType> signatures{ 0 };
-		std::array<std::vector<Index<RawData>>, SIZE> dataIndices;
+		MovableMutex(MovableMutex&&) noexcept {
+		}
 
-		std::vector<Index<Everything>> removed{};
+		MovableMutex& operator=(MovableMutex&&) noexcept {
+			return *this;
+		}
 
-		std::vector<RawData> data{ SIZE };
+		~MovableMutex() = default;
+	};
 
+	struct OwningGroup
+	{
+		SignatureType signature{};
+		// Owned type whose pool is used to look up the entities in the group.
+		Index<Component> pivot{ 0 };
+		// Members occupy the slots [1, size] of every owned pool.
+		size_t size = 0;
+	};
 
-		WeakObject make();
-		UniqueObject makeUnique();
+	enum class Strategy
+	{
+		// Parallel walk over the front of the pools owned by a group.
+		group,
+		// Galloping merge join over pools sorted by entity.
+		merge,
+		// Walk the smallest pool and test the signature of every object.
+		pivot,
+		// Walk the smallest pool in batches, prefetching the signatures and then
+		// the components of a batch before testing and calling it.
+		prefetch,
+		// And the presence bitmaps.
+		bitmap,
+	};
 
-		UniqueObject cloneAll(WeakObject const& obj);
+	struct QueryPlan
+	{
+		Strategy strategy = Strategy::bitmap;
+		Index<Component> pivot{ 0 };
+		Index<OwningGroup> group{ 0 };
+
+		// The filter of the query with the AnyOf terms ordered from the most to
+		// the least selective.
+		QueryFilter filter{};
+
+		// Fraction of the objects in the pivot pool passing the filter, sampled
+		// when the plan was made or taken from the runs of the plan before it.
+		double passRate = 1.0;
+		bool sampled = false;
+
+		// Objects of the pivot pool and calls of f over the runs of the plan,
+		// the plan is made again when they stray too far from passRate.
+		MovableAtomic<size_t> walked{ 0 };
+		MovableAtomic<size_t> passed{ 0 };
+
+		inline std::optional<double> observedPassRate() const;
+
+		// The state the plan was made for, it is made again when the counts
+		// drift by more than a factor of two or when groups or sorting change.
+		size_t entities = 0;
+		size_t groups = 0;
+		bool mergeable = false;
+		std::array<size_t, SIZE> counts{};
+	};
 
-		template<class... Ms>
-		UniqueObject clone(WeakObject const& obj);
+	// Where a match spread over several calls continues. The position is an
+	// entity index, so it stays valid when pools are packed, sorted or grow.
+	// Entities added behind the position are visited in the next pass.
+	struct QueryCursor
+	{
+		Index<Everything> position{ 1 };
+
+		// Completed passes over every entity.
+		size_t passes = 0;
+
+		inline void reset() {
+			this->position.set(1);
+		}
+	};
+
+	// How much one call of a cursor match may do, whichever runs out first.
+	// The time is checked every few entities.
+	struct QueryBudget
+	{
+		size_t entities = std::numeric_limits<size_t>::max();
+		std::chrono::microseconds time = std::chrono::microseconds::max();
+	};
+
+	enum class Lookup
+	{
+		// Entities by value, for exact lookups.
+		hash,
+		// Entities sorted by value, for exact lookups and range scans.
+		ordered,
+	};
+
+	// The entities of a field index, by the value of the field.
+	template<auto member, Lookup lookup>
+	struct FieldEntries
+	{
+		using value_type = member_value_t<member>;
+
+		// The value each entity was added with, removals don't need the component.
+		std::unordered_map<Index<Everything>, value_type> values{};
+
+		std::conditional_t<lookup == Lookup::hash,
+			std::unordered_map<value_type, std::vector<Index<Everything>>>,
+			std::set<std::pair<value_type, Index<Everything>>>
+		> entities{};
+
+		inline void insert(Index<Everything> i, value_type const& value);
+		inline void erase(Index<Everything> i);
+	};
+
+	// A secondary index over one field of a component type, entries are added
+	// and removed with the components. Changes to the field through get are
+	// only picked up by modify or reindex.
+	struct FieldIndex
+	{
+		Index<Component> type{ 0 };
+
+		// The FieldEntries of the field.
+		std::unique_ptr<void, void(*)(void*)> entries{ nullptr, nullptr };
+
+		void (*insert)(Everything& e, void* entries, Index<Everything> i) = nullptr;
+		void (*erase)(void* entries, Index<Everything> i) = nullptr;
+		void (*clear)(void* entries) = nullptr;
+	};
+
+	// Parent links in flat arrays, one per depth. Children are always one
+	// level below their parent, so walking the levels in order is a breadth
+	// first sweep that reaches every parent before its children. The children
+	// of each node are also linked in a list, so walking a subtree only visits
+	// its own nodes.
+	struct Hierarchy
+	{
+		struct Node
+		{
+			Index<Everything> entity{ 0 };
+			Index<Everything> parent{ 0 };
+		};
+
+		struct Slot
+		{
+			bool linked = false;
+			size_t depth = 0;
+			size_t position = 0;
+
+			Index<Everything> firstChild{ 0 };
+			Index<Everything> nextSibling{ 0 };
+			Index<Everything> previousSibling{ 0 };
+		};
+
+		std::vector<std::vector<Node>> levels{};
+
+		// By entity.
+		std::vector<Slot> slots{};
+
+	private:
+		inline Slot& slot(Index<Everything> i);
+
+		inline void append(Index<Everything> i, Index<Everything> parent, size_t depth);
+		inline void take(Index<Everything> i);
+		inline void trim();
+
+		// Adds i to the children of parent, or takes it out of the children of
+		// its parent.
+		inline void link(Index<Everything> i, Index<Everything> parent);
+		inline void unlink(Index<Everything> i);
+
+		// The subtree of i a level at a time, starting with i itself.
+		inline std::vector<std::vector<Index<Everything>>> collect(Index<Everything> i);
+
+	public:
+		inline bool contains(Index<Everything> i) const;
+		inline Index<Everything> getParent(Index<Everything> i) const;
+		inline size_t getDepth(Index<Everything> i) const;
+
+		// Links i under parent, or makes it a root when parent is 0. The
+		// descendants of i move along to their new depths.
+		inline void setParent(Index<Everything> i, Index<Everything> parent);
+
+		// Takes i out, its children become roots.
+		inline void erase(Index<Everything> i);
+
+		// Takes i out with all its descendants and appends them to out in
+		// breadth first order.
+		inline void eraseSubtree(Index<Everything> i, std::vector<Index<Everything>>& out);
+
+		// Calls f(Index<Everything>) for every child of i.
+		template<class F>
+		inline void children(Index<Everything> i, F f) const;
+	};
+
+	// The pairs of one relation type, as flat arrays sorted by source and by
+	// target. Inserted pairs are sorted in on the next lookup.
+	struct RelationPool
+	{
+		using Pair = std::pair<Index<Everything>, Index<Everything>>;
+
+		// (source, target) and (target, source).
+		std::vector<Pair> forward{};
+		std::vector<Pair> backward{};
+
+		bool sorted = true;
+
+		inline void sort();
+
+		inline void insert(Index<Everything> source, Index<Everything> target);
+		inline void erase(Index<Everything> source, Index<Everything> target);
+		inline bool contains(Index<Everything> source, Index<Everything> target);
+
+		// The pairs of forward starting with source, or of backward starting
+		// with target.
+		inline std::span<Pair const> bySource(Index<Everything> source);
+		inline std::span<Pair const> byTarget(Index<Everything> target);
+
+		// Drops the pairs with an entity that is not valid.
+		inline void purge(std::vector<int32_t> const& validIndices);
+	};
+
+	// A query over component types that are only known at runtime.
+	struct DynamicQuery
+	{
+		std::vector<Index<Component>> required{};
+		std::vector<Index<Component>> excluded{};
+
+		QueryFilter filter{};
+		std::vector<Index<Component>> pooled{};
+
+		// Key of the cached plan, queries with the same filter share it so a
+		// world keeps one plan per filter however many queries are made.
+		size_t id = 0;
+
+		// Plan ids by the with and without of their filter. Queries can be made
+		// on any thread, get takes the lock.
+		struct Ids
+		{
+			std::mutex mutex{};
+			std::unordered_map<SignatureType, std::vector<std::pair<SignatureType, size_t>>> byFilter{};
+
+			inline size_t get(QueryFilter const& filter);
+		};
+
+		inline DynamicQuery(std::vector<Index<Component>> required_, std::vector<Index<Component>> excluded_ = {});
+		DynamicQuery() = default;
+		~DynamicQuery() = default;
+
+		DEFAULT_COPY_MOVE(DynamicQuery);
+	};
+
+	struct NewEverything
+	{
+		Everything* ptr = nullptr;
+
+		NewEverything(Everything* p) : ptr(p) {};
+		NewEverything() = default;
+		~NewEverything() = default;
+	};
+
+	struct Everything
+	{
+		// Ids of queries, field indexes and relations, taken from any thread.
+		struct QueryCounter
+		{
+			std::atomic<size_t> t{ 0 };
+
+			size_t increment() {
+				return t.fetch_add(1, std::memory_order_relaxed);
+			}
+		};
+
+#ifdef LIB_SERIAL
+		// Relation ids by the type name of the relation, so a loaded world finds
+		// its pools under the ids of this process.
+		struct RelationIds
+		{
+			std::mutex mutex{};
+			std::unordered_map<std::string, size_t> byName{};
+
+			inline size_t get(std::string const& name);
+		};
+#endif
+
+		struct ComponentCounter
+		{
+			size_t t = 0;
+
+			Index<Component> increment() {
+				return { t++ };
+			}
+
+			size_t size() {
+				return t;
+			}
+		};
+
+		template<class T>
+		struct ComponentIndex
+		{
+			Index<Component> val = LazyGlobal<ComponentCounter>->increment();
+		};
+
+		template<class T>
+		struct component_index
+		{
+			static inline Index<Component> getVal() {
+				tassert(LazyGlobal<ComponentCounter>->size() < SIZE);
+
+				StructInformation info;
+#ifdef LIB_SERIAL
+				static_assert(serial::has_type_name<T>);
+				info.name = serial::Serializable<T>::typeName;
+#endif
+				info.index = LazyGlobal<ComponentIndex<T>>->val;
+				info.width = RawData::aligned_sizeof<T>::get();
+				info.storage = storage_policy_v<T>;
+				info.buffered = double_buffered_v<T>;
+				info.objectDestructor = [](void* obj) {
+					reinterpret_cast<T*>(obj)->~T();
+				};
+
+#ifdef LIB_SERIAL
+				info.objectReader = [](serial::Serializer& serializer, void* obj) {
+					return serializer.read<T>(std::forward<T>(*reinterpret_cast<T*>(obj)));
+				};
+
+				info.objectWriter = [](serial::Serializer& serializer, void* obj) {
+					return serializer.write<T>(std::forward<T>(*reinterpret_cast<T*>(obj)));
+				};
+
+				info.objectPrinter = [](serial::Serializer& serializer, void* obj) {
+					return serializer.print<T>(std::forward<T>(*reinterpret_cast<T*>(obj)));
+				};
+#endif
+
+				if constexpr (std::copy_constructible<T>) {
+					info.clone = [](void* source, void* target) {
+						new (target) T(*reinterpret_cast<T*>(source));
+					};
+				}
+
+				if constexpr (storage_policy_v<T> == Storage::split) {
+					static_assert(std::default_initializable<T>, "split components are put together from their fields");
+
+					std::apply([&](auto... members) {
+						([&] {
+							using M = typename member_pointer_traits<decltype(members)>::value_type;
+							static_assert(std::is_trivially_copyable_v<M>, "fields of split components are moved with memcpy");
+							static_assert(alignof(M) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+							info.columnWidths.push_back(sizeof(M));
+						}(), ...);
+					}, component_fields<T>::value);
+
+					info.load = [](RawData& pool, Index<RawData> i, void* target) {
+						new (target) T(pool.template load<T>(i));
+					};
+					info.store = [](RawData& pool, Index<RawData> i, void const* source) {
+						pool.template store<T>(i, *reinterpret_cast<T const*>(source));
+					};
+				}
+
+				if constexpr (double_buffered_v<T>) {
+					static_assert(storage_policy_v<T> == Storage::pool, "only pooled components can be double buffered");
+					static_assert(std::is_trivially_copyable_v<T>, "the front buffer holds byte copies");
+				}
+
+				if constexpr (storage_policy_v<T> == Storage::shared) {
+					static_assert(std::equality_comparable<T>, "shared components are interned by value");
+
+					info.hash = [](void* obj) {
+						return std::hash<T>()(*reinterpret_cast<T*>(obj));
+					};
+					info.equal = [](void* left, void* right) {
+						return *reinterpret_cast<T*>(left) == *reinterpret_cast<T*>(right);
+					};
+				}
+
+#ifdef LIB_SERIAL
+				LazyGlobal<StoredStructInformations>->infos.insert({ info.name, info });
+#else
+				LazyGlobal<StoredStructInformations>->infos.insert({ info.index, info });
+#endif
+				LazyGlobal<StoredStructInformations>->indexed[info.index] = info;
+
+				return info.index;
+			};
+
+			static inline Index<Component> val = getVal();
+		};
+
+		template<class T>
+		static inline Index<Component> component_index_v = component_index<T>::val;
+
+		template<class M, class... Ms>
+		struct group_signature
+		{
+			static const inline SignatureType fillSignature() {
+				SignatureType res{};
+				if constexpr (sizeof...(Ms) == 0) {
+					res.set(LazyGlobal<ComponentIndex<M>>->val);
+				}
+				else {
+					for (auto s : { LazyGlobal<ComponentIndex<M>>->val, LazyGlobal<ComponentIndex<Ms>>->val... }) {
+						res.set(s);
+					}
+				}
+				return res;
+			};
+
+			static const inline SignatureType value = fillSignature();
+		};
+
+		template<class... Ms>
+		static inline const SignatureType group_signature_v = group_signature<Ms...>::value;
+
+
+		std::vector<Index<Everything>> freeIndirections{};
+
+		std::vector<Qualifier> qualifiers{ 0 };
+		std::vector<int32_t> validIndices{ false };
+		Qualifier qualifier = 1;
+
+		std::vector<SignatureType> signatures{ 0 };
+		std::array<std::vector<Index<RawData>>, SIZE> dataIndices;
+
+		// Per component, one bit per entity, the transpose of signatures.
+		std::array<std::vector<uint64_t>, SIZE> presence{};
+		std::array<size_t, SIZE> counts{};
+
+		// Cached query plans by query id. Shared so a running match keeps its
+		// plan while f runs queries that replace it. Systems of a scheduler
+		// stage plan concurrently, plan and adoptPlan take the mutex.
+		std::unordered_map<size_t, std::shared_ptr<QueryPlan>> plans{};
+		MovableMutex plansMutex{};
+
+		// Field indexes by id, and the types that have one.
+		std::unordered_map<size_t, FieldIndex> fieldIndexes{};
+		SignatureType indexedTypes{};
+
+		Hierarchy hierarchy{};
+
+		// Relation pools by relation id.
+		std::unordered_map<size_t, RelationPool> relations{};
+
+		std::vector<Index<Everything>> removed{};
+
+		// Where objects moved to with moveEntity went, by their old index.
+		struct Forwarding
+		{
+			Qualifier qualifier = 0;
+			WeakObject target{};
+			Qualifier targetQualifier = 0;
+		};
+
+		std::unordered_map<Index<Everything>, Forwarding> forwardings{};
+
+		// Indices handed out by reserve and not materialized yet, taken from the
+		// back of freeIndirections first and then past the end of signatures.
+		MovableAtomic<size_t> reservedFree{ 0 };
+		MovableAtomic<size_t> reservedFresh{ 0 };
+
+		std::vector<RawData> data{ SIZE };
+
+		std::vector<OwningGroup> groups{ 1 };
+		std::array<Index<OwningGroup>, SIZE> groupOwners{};
+
+
+		WeakObject make();
+		UniqueObject makeUnique();
+
+		// Thread safe with other calls to reserve, but not with anything that
+		// makes or collects objects. The index can only be used after the next
+		// materialize.
+		Index<Everything> reserve();
+		void reserve(std::span<Index<Everything>> out);
+
+		// Grows the tables for every reserved index in one go, make and
+		// collectRemoved do this first when there are reservations pending.
+		void materialize();
+
+		UniqueObject cloneAll(WeakObject const& obj);
+
+		template<class... Ms>
+		UniqueObject clone(WeakObject const& obj);
 
 		UniqueObject clone(std::vector<Index<Component>> components, WeakObject const& obj);
 
-		std::optional<WeakObject> maybeGetFromIndex(Index<Everything> index);
-		WeakObject getFromIndex(Index<Everything> index);
-		bool isValidIndex(Index<Everything> index);
+		// Moves object i of from with all its components to a new object of to
+		// and returns its index. Components are relocated with memcpy, shared
+		// components are interned again in to. With forward set, from keeps a
+		// record so getForwarded can redirect old handles. The hierarchy links
+		// and relations of i are not carried over, they are dropped from from
+		// like for any removed object.
+		static Index<Everything> moveEntity(Everything& from, Everything& to, Index<Everything> i, bool forward = false);
+
+		// Moves every object of indices, out gets the new indices in the same
+		// order. The tables of to grow once for the whole batch.
+		static void moveEntities(Everything& from, Everything& to, std::span<Index<Everything> const> indices, std::span<Index<Everything>> out, bool forward = false);
+
+		static void relocate(Everything& from, Everything& to, Index<Everything> i, Index<Everything> j, bool forward);
+
+		// Appends every object of other to this world and leaves other empty.
+		// Pools are moved with one memcpy per array, dense and shared components
+		// per object. Returns where each index of other ended up.
+		IndexConverter<Everything, Everything> merge(Everything&& other);
+
+		// The object a handle with index i and qualifier q was moved to, following
+		// later moves as well. The target worlds have to outlive the records.
+		std::optional<WeakObject> getForwarded(Index<Everything> i, Qualifier q) const;
+		void clearForwarded();
+
+		std::optional<WeakObject> maybeGetFromIndex(Index<Everything> index);
+		WeakObject getFromIndex(Index<Everything> index);
+		bool isValidIndex(Index<Everything> index);
+
+		Qualifier getNextQualifier();
+		bool isQualified(Index<Everything> i, Qualifier q) const;
+		Qualifier getQualifier(Index<Everything> i) const;
+
+		inline void remove(Index<Everything> i);
+
+		void collectRemoved();
+		inline void packDeletions(Index<Component> type);
+
+		// Sorts the pool of T in place with compare(T const&, T const&). Members
+		// of an owning group stay at the front and the other owned pools follow
+		// their new order.
+		template<class T, class F>
+		inline void sort(F compare);
+
+		// Sorts the pool of T by entity index.
+		template<class T>
+		inline void sortByEntity();
+
+		// Orders the pool of T like the pool of Lead, entities without Lead go
+		// to the back in their current order.
+		template<class T, class Lead>
+		inline void sortLike();
+
+		inline void applyOrder(Index<Component> type, std::vector<Index<RawData>> const& order);
+
+		template<class T>
+		inline void removeComponent(Index<Everything> i);
+		inline void removeComponent(Index<Everything> i, Index<Component> type);
+
+		template<class T>
+		inline void removeAll();
+		inline void removeAll(Index<Component> type);
+
+		template<class T, class... Args>
+		inline component_reference_t<T> add(Index<Everything> i, Args&&... args);
+
+		// Points i at the interned value made from args. The value is interned
+		// before the old one is released, so args can refer to it.
+		template<class T, class... Args>
+		inline component_reference_t<T> replaceShared(Index<Everything> i, Args&&... args);
+
+		// Marks the slot dirty for double buffered T.
+		template<class T>
+		inline component_reference_t<T> get(Index<Everything> i);
+
+		// Double buffered T as it was at the last swapBuffers.
+		template<class T>
+		inline T const& getPrevious(Index<Everything> i);
+
+		// Tick boundary of every double buffered component, the values written
+		// since the last swap become the ones getPrevious returns.
+		inline void swapBuffers();
+
+		template<class T>
+		inline void swapBuffers();
+
+		// Split storage, the field of the component of entity i, in place.
+		template<auto member>
+		inline member_value_t<member>& field(Index<Everything> i);
+
+		// Split storage, the field of every component of its type in slot order.
+		// Packs the pending deletions of the pool first.
+		template<auto member>
+		inline std::span<member_value_t<member>> fieldSpan();
+
+		// The entities of the slots of fieldSpan, in the same order.
+		template<class T>
+		inline std::span<Index<Everything> const> slotEntities();
+
+		// Calls f(std::span<Index<Everything> const> entities, std::span<Ms>...)
+		// once with the arrays of the given fields of one split component, for
+		// kernels that only touch some of its fields.
+		template<auto... members, class F>
+		inline void matchFields(F f);
+
+		template<class T>
+		inline RawData& gets();
+
+		inline RawData& gets(Index<Component> type);
+
+#ifdef LIB_SERIAL
+		bool print(serial::Serializer& serializer, Index<Everything> index, Index<Component> type);
+#endif
+
+		// Declares an owning group, the entities with all of Ts are kept packed at
+		// the front of every pool of Ts in the same order. A type can be owned by
+		// at most one group.
+		template<class... Ts>
+		Index<OwningGroup> group();
+
+		template<class... Ms>
+		OwningGroup const* selectGroup() const;
+		OwningGroup const* selectGroup(std::span<Index<Component> const> pooled) const;
+
+		inline void enterGroup(Index<OwningGroup> group, Index<Everything> i);
+		inline void leaveGroup(Index<OwningGroup> group, Index<Everything> i);
+
+		template<class... Ts>
+		inline bool has(Index<Everything> i) const;
+
+		inline bool has(Index<Everything> i, Index<Component> type) const;
+
+		Index<RawData> getComponentIndex(Index<Everything> i, Index<Component> type) const;
+
+		template<class F>
+		inline void run(F f);
+
+		template<class F>
+		inline void match(F f);
+
+		// Makes the plan match(f) would use up to date. Concurrent matches only
+		// read the plan cache as long as nothing changes the structure of the
+		// world in between.
+		template<class F>
+		inline QueryPlan const& preparePlan();
+
+		// Caches plan, made by another world for match(f), unless this world
+		// has an up to date plan of its own or plan is stale here. The worlds
+		// have to declare the same owning groups in the same order.
+		template<class F>
+		inline void adoptPlan(QueryPlan const& plan);
+
+		inline void adoptPlan(size_t id, QueryPlan const& plan, std::span<Index<Component> const> pooled);
+
+		// Calls f(WeakObject, std::span<void* const> components) for every entity
+		// matching query, with a pointer to each required component in the order
+		// of query.required. Tags and split components have no single address
+		// and get nullptr.
+		template<class F>
+		inline void match(DynamicQuery const& query, F f);
+
+		// Continues match(f) at cursor until the budget runs out. Returns true
+		// when the pass reached the last entity, the cursor then starts over.
+		template<class F>
+		inline bool match(QueryCursor& cursor, QueryBudget const& budget, F f);
+
+		// Calls f(Index<Everything>) for every entity passing the filter of plan.
+		template<class F>
+		inline void execute(QueryPlan const& plan, std::span<Index<Component> const> pooled, F f);
+
+		inline void* getUntyped(Index<Everything> i, Index<Component> type);
+
+		// Registers a component type from a runtime layout, its objects live in
+		// pools like those of native types. Only pool and dense storage are
+		// supported. Without serializer callbacks these types can not be saved.
+		static inline Index<Component> registerComponent(ComponentDescriptor const& descriptor);
+
+		// Adds a default constructed component of a type registered at runtime.
+		inline void* addUntyped(Index<Everything> i, Index<Component> type);
+
+		// Pointer to the field called name of the component, nullptr if the type
+		// has no such field.
+		inline void* getField(Index<Everything> i, Index<Component> type, std::string_view name);
+
+		// Calls f(T const& value, std::span<WeakObject const> objects) once for
+		// every distinct value of the shared component T.
+		template<class T, class F>
+		inline void groupBy(F f);
+
+		// Declares an index over a field of a component type. It is built from
+		// the components there are and kept up to date as components are added
+		// and removed. The field needs std::hash for hash lookups and operator<
+		// for ordered ones.
+		template<auto member, Lookup lookup = Lookup::hash>
+		inline void indexField();
+
+		template<auto member, Lookup lookup = Lookup::hash>
+		inline bool hasFieldIndex() const;
+
+		// An entity whose field equals value.
+		template<auto member, Lookup lookup = Lookup::hash>
+		inline std::optional<WeakObject> findOne(member_value_t<member> const& value);
+
+		// Calls f(WeakObject) for every entity whose field equals value. f must
+		// not add or remove the component or change the field.
+		template<auto member, Lookup lookup = Lookup::hash, class F>
+		inline void find(member_value_t<member> const& value, F f);
+
+		// Calls f(WeakObject) for every entity with a field in [lo, hi), in order
+		// of the field. Needs an ordered index.
+		template<auto member, class F>
+		inline void findRange(member_value_t<member> const& lo, member_value_t<member> const& hi, F f);
+
+		// Calls f(T&) with the component of entity i and updates the field
+		// indexes of T after.
+		template<class T, class F>
+		inline void modify(Index<Everything> i, F f);
+
+		// Updates the field indexes of the component of entity i, after it was
+		// changed through get.
+		inline void reindex(Index<Everything> i, Index<Component> type);
+
+		// Fills the field indexes again from the components there are, after
+		// they were loaded or changed without reindex.
+		inline void rebuildFieldIndexes();
+
+		template<auto member, Lookup lookup>
+		static inline size_t fieldIndexId();
+
+		// Links i under parent in the hierarchy, or makes it a root when parent
+		// is 0. Removing an object makes its children roots.
+		inline void setParent(Index<Everything> i, Index<Everything> parent);
+		inline Index<Everything> getParent(Index<Everything> i) const;
+
+		// Calls f(Index<Everything> i, Index<Everything> parent) for every object
+		// in the hierarchy, one depth after the other, so parents come before
+		// their children. f must not change the hierarchy.
+		template<class F>
+		inline void traverse(F f);
+
+		// Removes i and all its descendants in the hierarchy.
+		inline void removeRecursive(Index<Everything> i);
+
+		// Relates source to target with the relation R, any type used as a
+		// name, with LIB_SERIAL it needs a typeName. Pairs with a removed object
+		// are dropped in collectRemoved.
+		template<class R>
+		inline void relate(Index<Everything> source, Index<Everything> target);
+
+		template<class R>
+		inline void unrelate(Index<Everything> source, Index<Everything> target);
+
+		template<class R>
+		inline bool isRelated(Index<Everything> source, Index<Everything> target);
+
+		// Calls f(WeakObject) for every object source is related to with R.
+		template<class R, class F>
+		inline void targets(Index<Everything> source, F f);
+
+		// Calls f(WeakObject) for every object related to target with R.
+		template<class R, class F>
+		inline void sources(Index<Everything> target, F f);
+
+		template<class R>
+		static inline size_t relationId();
+
+		// Called whenever a component is added or removed, after its value is in
+		// place, these also keep the field indexes.
+		inline void setPresence(Index<Everything> i, Index<Component> type);
+		inline void resetPresence(Index<Everything> i, Index<Component> type);
+
+		// Calls f(Index<Everything>) for every entity with all components in
+		// with and none in without, by and-ing the presence bitmaps a block of
+		// words at a time and skipping empty words of 64 entities.
+		template<class F>
+		inline void scan(SignatureType with, SignatureType without, F f);
+
+		template<class F>
+		inline void scan(SignatureType signature, F f);
+
+		// Like scan a word of 64 entities at a time, starting at entity from and
+		// stopping when f returns false. Returns the entity after the last one f
+		// was called for, or the end of the entities.
+		template<class F>
+		inline Index<Everything> scanFrom(Index<Everything> from, SignatureType with, SignatureType without, F f);
+
+		// Returns the cached plan of query id, making a new one when the world
+		// changed too much since it was made.
+		inline std::shared_ptr<QueryPlan> plan(size_t id, QueryFilter const& filter, std::span<Index<Component> const> pooled);
+
+		// Uses observed for the pass rate when given, the sample then only
+		// orders the AnyOf terms.
+		inline QueryPlan makePlan(QueryFilter const& filter, std::span<Index<Component> const> pooled, std::optional<double> observed = {}) const;
+		inline bool isStale(QueryPlan const& plan, std::span<Index<Component> const> pooled) const;
+
+		// Intersects the sorted pools of types with a galloping merge join and
+		// calls f(Index<Everything>, std::span<Index<RawData> const>) with the
+		// slot of the entity in each pool, in entity order.
+		template<class F>
+		inline void mergeJoin(std::span<Index<Component> const> types, F f);
+
+		inline bool canMergeJoin(std::span<Index<Component> const> types) const;
+
+		template<class... Ms>
+		std::optional<Index<Component>> selectPivot();
+		std::optional<Index<Component>> selectPivot(std::span<Index<Component> const> pooled) const;
+
+		size_t getTypeCount();
+		Storage getStorage(Index<Component> type) const;
+
+		Everything();
+		~Everything() = default;
+
+		NO_COPY(Everything);
+		DEFAULT_MOVE(Everything);
+	};
+
+	struct Loop
+	{
+		template<class E, class F>
+		static inline void run(E& e, F f) {
+			using A = te::reverse_t<te::arguments_list_t<F>>;
+			Loop::run<E, F, A>(e, f);
+		}
+
+		template<class E, class F, te::list L, class... Args>
+		static inline void run(E& e, F f, Args... args) {
+			if constexpr (te::is_empty_v<L>) {
+				f(args...);
+			}
+			else {
+				using head_stripped_ref = std::remove_reference_t<te::head_t<L>>;
+				head_stripped_ref::template run<F, te::tail_t<L>, Args...>(e, f, args...);
+			}
+		}
+	};
+
+	template<class M, class... Ms>
+	struct Match
+	{
+		WeakObject obj;
+
+		template<class T>
+		inline component_reference_t<T> get() {
+			static_assert(te::contains_v<te::list_type<M, Ms...>, T>);
+			return this->obj.template get<T>();
+		};
+
+		template<class T>
+		inline void remove() {
+			static_assert(te::contains_v<te::list_type<M, Ms...>, T>);
+			this->obj.template remove<T>();
+		};
+
+		template<class F, class L, class... Args>
+		static inline void run(Everything& e, F f, Args... args) {
+			auto pivot = e.selectPivot<M, Ms...>();
+
+			if (!pivot.has_value()) {
+				e.scan(Everything::group_signature_v<M, Ms...>, [&](Index<Everything> index) {
+					Loop::run<Everything, F, L, Match<M, Ms...>, Args...>(e, f, Match<M, Ms...>{ { index, & e } }, args...);
+				});
+				return;
+			}
+
+			auto& g = e.gets(pivot.value());
+			const auto end = g.index;
+
+			if constexpr (sizeof...(Ms) == 0) {
+				for (Index<RawData> i{ 1 }; i < end; i++) {
+					auto index = g.getIndex(i);
+					Loop::run<Everything, F, L, Match<M, Ms...>, Args...>(e, f, Match<M, Ms...>{ { index, & e } }, args...);
+				}
+			}
+			else {
+				for (Index<RawData> i{ 1 }; i < end; i++) {
+					auto index = g.getIndex(i);
+
+					if (e.has<M, Ms...>(index)) {
+						Loop::run<Everything, F, L, Match<M, Ms...>, Args...>(e, f, Match<M, Ms...>{ { index, & e } }, args...);
+					}
+				}
+			}
+		};
+	};
+
+	template<class L>
+	struct MatchExpanded;
+
+	template<class T>
+	struct QueryTerm
+	{
+		static constexpr bool required = true;
+		static constexpr Storage storage = storage_policy_v<T>;
+		static constexpr bool buffered = double_buffered_v<T>;
+
+		static inline Index<Component> type() {
+			return LazyGlobal<Everything::ComponentIndex<T>>->val;
+		}
+
+		static inline void fill(QueryFilter& filter) {
+			filter.with.set(type());
+		}
+
+		static inline component_reference_t<T> get(Everything& e, Index<Everything> i) {
+			return e.get<T>(i);
+		}
+
+		static inline component_reference_t<T> getSlot(std::byte* base, Index<RawData> slot) {
+			return *reinterpret_cast<T*>(base + slot * RawData::aligned_sizeof<T>::get());
+		}
+	};
+
+	template<class T>
+	struct QueryTerm<Without<T>>
+	{
+		static constexpr bool required = false;
+
+		static inline void fill(QueryFilter& filter) {
+			filter.without.set(LazyGlobal<Everything::ComponentIndex<T>>->val);
+		}
+
+		static inline Without<T> get(Everything&, Index<Everything>) {
+			return {};
+		}
+	};
+
+	template<class T>
+	struct QueryTerm<Optional<T>>
+	{
+		static constexpr bool required = false;
+
+		static inline void fill(QueryFilter&) {
+		}
+
+		static inline Optional<T> get(Everything& e, Index<Everything> i) {
+			static_assert(storage_policy_v<T> != Storage::split, "split components are read by value");
+
+			if (e.has<T>(i)) {
+				return { &e.get<T>(i) };
+			}
+			else {
+				return {};
+			}
+		}
+	};
+
+	template<class T>
+	struct QueryTerm<Previous<T>>
+	{
+		static constexpr bool required = true;
+		static constexpr Storage storage = storage_policy_v<T>;
+		static constexpr bool buffered = true;
+
+		static inline Index<Component> type() {
+			return LazyGlobal<Everything::ComponentIndex<T>>->val;
+		}
+
+		static inline void fill(QueryFilter& filter) {
+			filter.with.set(type());
+		}
+
+		static inline T const& get(Everything& e, Index<Everything> i) {
+			return e.getPrevious<T>(i);
+		}
+	};
+
+	template<class... Ts>
+	struct QueryTerm<AnyOf<Ts...>>
+	{
+		static constexpr bool required = false;
+
+		static inline void fill(QueryFilter& filter) {
+			filter.anyOf.push_back(Everything::group_signature<Ts...>::fillSignature());
+		}
+
+		static inline AnyOf<Ts...> get(Everything&, Index<Everything>) {
+			return {};
+		}
+	};
+
+	template<bool object, class... Args>
+	struct MatchExecution
+	{
+		static_assert(sizeof...(Args) != 0);
+
+		// Double buffered terms go through the entity, writes have to mark their
+		// slot dirty.
+		template<class T>
+		static constexpr bool pooled = [] {
+			if constexpr (QueryTerm<T>::required) {
+				return QueryTerm<T>::storage == Storage::pool && !QueryTerm<T>::buffered;
+			}
+			else {
+				return false;
+			}
+		}();
+
+		static constexpr size_t pooledCount = (size_t(pooled<Args>) + ...);
+
+		static constexpr std::array<bool, sizeof...(Args)> pooledFlags{ pooled<Args>... };
+
+		// Position of the I-th term among the pooled terms of the query.
+		template<size_t I>
+		static constexpr size_t pooledPosition() {
+			size_t res = 0;
+			for (size_t i = 0; i < I; i++) {
+				res += pooledFlags[i];
+			}
+			return res;
+		}
+
+		using Bases = std::array<std::byte*, sizeof...(Args)>;
+
+		static inline QueryFilter const& filter() {
+			static const QueryFilter res = [] {
+				QueryFilter res{};
+				(QueryTerm<Args>::fill(res), ...);
+				res.mask = res.with | res.without;
+				return res;
+			}();
+			return res;
+		}
+
+		static inline std::array<Index<Component>, pooledCount> const& pooledTypes() {
+			static const auto res = [] {
+				std::array<Index<Component>, pooledCount> res{};
+				size_t k = 0;
+				([&] {
+					if constexpr (pooled<Args>) {
+						res[k++] = QueryTerm<Args>::type();
+					}
+				}(), ...);
+				return res;
+			}();
+			return res;
+		}
+
+		// The data of the pooled terms. Adding a component in f can grow its
+		// pool, so the loops read them again after every call of f.
+		static inline Bases getBases(Everything& e) {
+			Bases res{};
+			size_t k = 0;
+			([&] {
+				if constexpr (pooled<Args>) {
+					res[k] = e.gets(QueryTerm<Args>::type()).data.data();
+				}
+				k++;
+			}(), ...);
+			return res;
+		}
+
+		template<class F, class... Terms>
+		static inline void call(Everything& e, F& f, Index<Everything> index, Terms&&... terms) {
+			if constexpr (object) {
+				f(WeakObject{ index, &e }, std::forward<Terms>(terms)...);
+			}
+			else {
+				f(std::forward<Terms>(terms)...);
+			}
+		}
+
+		template<size_t I, class T>
+		static inline decltype(auto) getAt(Everything& e, Bases const& bases, Index<RawData> slot, Index<Everything> index) {
+			if constexpr (pooled<T>) {
+				return QueryTerm<T>::getSlot(bases[I], slot);
+			}
+			else {
+				return QueryTerm<T>::get(e, index);
+			}
+		}
+
+		template<size_t I, class T>
+		static inline decltype(auto) getMerged(Everything& e, Bases const& bases, std::span<Index<RawData> const> slots, Index<Everything> index) {
+			if constexpr (pooled<T>) {
+				return QueryTerm<T>::getSlot(bases[I], slots[pooledPosition<I>()]);
+			}
+			else {
+				return QueryTerm<T>::get(e, index);
+			}
+		}
+
+		template<class F>
+		static inline void callIndex(Everything& e, F& f, Index<Everything> index) {
+			call(e, f, index, QueryTerm<Args>::get(e, index)...);
+		}
+
+		static inline size_t id() {
+			static const size_t res = LazyGlobal<Everything::QueryCounter>->increment();
+			return res;
+		}
+
+		// Members of an owning group are packed at the front of every owned pool
+		// in the same order, the other terms are fetched by entity.
+		template<class F>
+		static inline void runGroup(Everything& e, F& f, QueryPlan const& plan) {
+			auto const& group = e.groups[plan.group];
+			auto const& query = plan.filter;
+			const auto end = Index<RawData>{ group.size + 1 };
+			const bool exact = query.mask == group.signature && query.anyOf.empty();
+
+			auto bases = getBases(e);
+			auto& g = e.gets(group.pivot);
+
+			[&]<size_t... Is>(std::index_sequence<Is...>) {
+				for (Index<RawData> i{ 1 }; i < end; i++) {
+					auto index = g.getIndex(i);
+
+					if (!exact && !query.test(e.signatures[index])) {
+						continue;
+					}
+
+					call(e, f, index, getAt<Is, Args>(e, bases, i, index)...);
+					bases = getBases(e);
+				}
+			}(std::index_sequence_for<Args...>{});
+		}
+
+		template<class F>
+		static inline void runMerged(Everything& e, F& f, QueryPlan const& plan) {
+			if constexpr (pooledCount >= 2) {
+				auto const& query = plan.filter;
+				const bool exact = query.mask.count() == pooledCount && query.anyOf.empty();
+				auto bases = getBases(e);
+
+				[&]<size_t... Is>(std::index_sequence<Is...>) {
+					e.mergeJoin(pooledTypes(), [&](Index<Everything> index, std::span<Index<RawData> const> slots) {
+						if (!exact && !query.test(e.signatures[index])) {
+							return;
+						}
+
+						call(e, f, index, getMerged<Is, Args>(e, bases, slots, index)...);
+						bases = getBases(e);
+					});
+				}(std::index_sequence_for<Args...>{});
+			}
+		}
+
+		template<class F>
+		static inline void runBitmap(Everything& e, F& f, QueryPlan const& plan) {
+			auto const& query = plan.filter;
+
+			e.scan(query.with, query.without, [&](Index<Everything> index) {
+				if (query.anyOf.empty() || query.test(e.signatures[index])) {
+					callIndex(e, f, index);
+				}
+			});
+		}
+
+		template<class F>
+		static inline void runPivot(Everything& e, F& f, QueryPlan const& plan) {
+			auto const& query = plan.filter;
+			auto& g = e.gets(plan.pivot);
+			const auto end = g.index;
+
+			if constexpr (sizeof...(Args) == 1 && pooledCount == 1) {
+				auto bases = getBases(e);
+				// Removed objects stay in the pool as dead slots until collectRemoved.
+				const bool dense = g.deletions.empty();
+				for (Index<RawData> i{ 1 }; i < end; i++) {
+					if (!dense && g.getIndex(i) == 0) {
+						continue;
+					}
+
+					if constexpr (object) {
+						call(e, f, g.getIndex(i), QueryTerm<Args>::getSlot(bases[0], i)...);
+					}
+					else {
+						call(e, f, Index<Everything>{ 0 }, QueryTerm<Args>::getSlot(bases[0], i)...);
+					}
+
+					bases = getBases(e);
+				}
+			}
+			else {
+				for (Index<RawData> i{ 1 }; i < end; i++) {
+					auto index = g.getIndex(i);
+
+					if (query.test(e.signatures[index])) {
+						callIndex(e, f, index);
+					}
+				}
+			}
+		}
+
+		// Hides the latency of the dependent loads of the pivot loop by splitting
+		// it in phases over a batch: gather the entities, prefetch their
+		// signatures and data indices, filter and prefetch the components, call.
+		template<class F>
+		static inline void runPrefetch(Everything& e, F& f, QueryPlan const& plan) {
+			constexpr size_t batchSize = 64;
+
+			auto const& query = plan.filter;
+			auto const& types = pooledTypes();
+			auto& g = e.gets(plan.pivot);
+			const auto end = g.index;
+
+			std::array<Index<Everything>, batchSize> batch;
+
+			for (Index<RawData> i{ 1 }; i < end;) {
+				size_t count = 0;
+
+				for (; i < end && count < batchSize; i++) {
+					auto index = g.getIndex(i);
+
+					if (index != 0) {
+						batch[count++] = index;
+						MEM_PREFETCH(&e.signatures[index]);
+
+						for (auto type : types) {
+							MEM_PREFETCH(&e.dataIndices[type][index]);
+						}
+					}
+				}
+
+				size_t passed = 0;
+
+				for (size_t k = 0; k < count; k++) {
+					auto index = batch[k];
+
+					if (!query.test(e.signatures[index])) {
+						continue;
+					}
+
+					batch[passed++] = index;
+
+					for (auto type : types) {
+						MEM_PREFETCH(e.gets(type).getUntyped(e.dataIndices[type][index]));
+					}
+				}
+
+				for (size_t k = 0; k < passed; k++) {
+					auto index = batch[k];
+
+					// Earlier calls of the batch can change the signature.
+					if (query.test(e.signatures[index])) {
+						callIndex(e, f, index);
+					}
+				}
+			}
+		}
+
+		static inline QueryPlan const& prepare(Everything& e) {
+			return *e.plan(id(), filter(), pooledTypes());
+		}
+
+		template<class F>
+		static inline bool runCursor(Everything& e, F f, QueryCursor& cursor, QueryBudget const& budget) {
+			using clock = std::chrono::steady_clock;
+			constexpr size_t clockInterval = 16;
+
+			auto const& query = filter();
+			const auto start = clock::now();
+			size_t count = 0;
+
+			// Entities rejected by the AnyOf terms count for the clock too, a
+			// sparse pass can test many of them between two calls.
+			size_t scanned = 0;
+
+			auto next = e.scanFrom(cursor.position, query.with, query.without, [&](Index<Everything> index) {
+				scanned++;
+
+				if (query.anyOf.empty() || query.test(e.signatures[index])) {
+					callIndex(e, f, index);
+					count++;
+
+					if (count >= budget.entities) {
+						return false;
+					}
+				}
+
+				return scanned % clockInterval != 0
+					|| std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start) < budget.time;
+			});
+
+			if (next >= e.signatures.size()) {
+				cursor.reset();
+				cursor.passes++;
+				return true;
+			}
+
+			cursor.position = next;
+			return false;
+		}
+
+		static inline void adopt(Everything& e, QueryPlan const& plan) {
+			e.adoptPlan(id(), plan, pooledTypes());
+		}
+
+		template<class F>
+		static inline void run(Everything& e, F f) {
+			// Kept alive, f is allowed to run queries that replace the cached plan.
+			const std::shared_ptr<QueryPlan> plan = e.plan(id(), filter(), pooledTypes());
+			const size_t walked = plan->sampled ? e.counts[plan->pivot] : 0;
+
+			size_t calls = 0;
+			auto counted = [&](auto&&... args) {
+				calls++;
+				f(std::forward<decltype(args)>(args)...);
+			};
+
+			switch (plan->strategy) {
+				case Strategy::group:
+					runGroup(e, counted, *plan);
+					break;
+				case Strategy::merge:
+					runMerged(e, counted, *plan);
+					break;
+				case Strategy::pivot:
+					runPivot(e, counted, *plan);
+					break;
+				case Strategy::prefetch:
+					if constexpr (sizeof...(Args) == 1 && pooledCount == 1) {
+						// Reads the pool sequentially, nothing to hide.
+						runPivot(e, counted, *plan);
+					}
+					else {
+						runPrefetch(e, counted, *plan);
+					}
+					break;
+				case Strategy::bitmap:
+					runBitmap(e, counted, *plan);
+					break;
+			}
+
+			if (walked != 0) {
+				plan->walked.value.fetch_add(walked, std::memory_order_relaxed);
+				plan->passed.value.fetch_add(calls, std::memory_order_relaxed);
+			}
+		};
+	};
+
+	template<class... Args>
+	struct MatchExpanded<te::list_type<WeakObject, Args...>>
+	{
+		template<class F>
+		static inline void run(Everything& e, F f) {
+			MatchExecution<true, Args...>::run(e, f);
+		};
+
+		static inline QueryPlan const& prepare(Everything& e) {
+			return MatchExecution<true, Args...>::prepare(e);
+		}
+
+		static inline void adopt(Everything& e, QueryPlan const& plan) {
+			MatchExecution<true, Args...>::adopt(e, plan);
+		}
+
+		template<class F>
+		static inline bool runCursor(Everything& e, F f, QueryCursor& cursor, QueryBudget const& budget) {
+			return MatchExecution<true, Args...>::runCursor(e, f, cursor, budget);
+		}
+	};
+
+	template<class... Args>
+	struct MatchExpanded<te::list_type<Args...>>
+	{
+		template<class F>
+		static inline void run(Everything& e, F f) {
+			MatchExecution<false, Args...>::run(e, f);
+		};
+
+		static inline QueryPlan const& prepare(Everything& e) {
+			return MatchExecution<false, Args...>::prepare(e);
+		}
+
+		static inline void adopt(Everything& e, QueryPlan const& plan) {
+			MatchExecution<false, Args...>::adopt(e, plan);
+		}
+
+		template<class F>
+		static inline bool runCursor(Everything& e, F f, QueryCursor& cursor, QueryBudget const& budget) {
+			return MatchExecution<false, Args...>::runCursor(e, f, cursor, budget);
+		}
+	};
+
+	template<class T>
+	inline void RawData::remove(Index<RawData> i) {
+		tassert(i != 0);
+		tassert(i < this->index);
+		tassert(this->objectSize != 0);
+		tassert(this->objectSize == aligned_sizeof<T>::get());
+		this->removeUntyped(i);
+	}
+
+	inline std::vector<RawData::DeletedInfo> RawData::packDeletions() {
+		std::vector<RawData::DeletedInfo> res;
+
+		std::sort(this->deletions.begin(), this->deletions.end(), [](auto left, auto right) {return left.i > right.i; });
+
+		for (auto i : this->deletions) {
+			const auto last = --this->index;
+
+			if (i == last) {
+				this->indices.pop_back();
+				continue;
+			}
+			else {
+				this->forColumns([&](std::vector<std::byte>& bytes, size_t width) {
+					std::memcpy(&bytes[i * width], &bytes[last * width], width);
+				});
+				this->sorted = false;
+				auto changed = this->indices.back();
+				this->indices.pop_back();
+
+				this->indices[i] = changed;
+
+				res.push_back({ i, changed });
+			}
+		}
+
+		this->deletions.clear();
+
+		return res;
+	}
+
+	inline RawData::~RawData() {
+		tassert(this->deletions.empty());
+
+		// Fields of split storage are trivially destructible.
+		if (this->structInformation.storage == Storage::split) {
+			return;
+		}
+
+		for (Index<RawData> i{ 1 }; i < this->index; i++) {
+			if (this->isAlive(i)) {
+				this->structInformation.objectDestructor(this->getUntyped(i));
+			}
+		}
+	}
+
+	inline void RawData::removeUntyped(Index<RawData> i) {
+		tassert(i != 0);
+		tassert(i < this->index);
+
+		if (this->structInformation.storage != Storage::split) {
+			this->structInformation.objectDestructor(this->getUntyped(i));
+		}
+
+		this->indices[i].set(0);
+		this->deletions.push_back(i);
+	}
+
+	inline void RawData::removeAtUntyped(Index<RawData> i) {
+		tassert(i != 0);
+		tassert(i < this->index);
+		tassert(this->indices[i] != 0);
+
+		this->structInformation.objectDestructor(this->getUntyped(i));
+		this->indices[i].set(0);
+	}
+
+	template<class T>
+	inline T& RawData::get(Index<RawData> i) {
+		tassert(i != 0);
+		tassert(i < this->reservedObjects);
+		return *reinterpret_cast<T*>(&this->data[aligned_sizeof<T>::get() * i]);
+	}
+
+	inline void* RawData::getUntyped(Index<RawData> i) {
+		tassert(this->structInformation.storage != Storage::split);
+		tassert(i != 0);
+		tassert(i < this->reservedObjects);
+		return static_cast<void*>(&this->data[this->objectSize * i]);
+	}
+
+	inline Index<Everything> RawData::getIndex(Index<RawData> i) const {
+		tassert(i != 0);
+		tassert(i < this->index);
+		return this->indices[i];
+	}
+
+	inline void RawData::appendIndex(Index<Everything> i) {
+		// The last slot can be a removed object which is not packed yet, in that
+		// case the order is unknown.
+		if (this->indices.size() > 1 && !(this->indices.back() != 0 && this->indices.back().i < i.i)) {
+			this->sorted = false;
+		}
+
+		this->indices.push_back(i);
+	}
+
+	inline Index<RawData> RawData::gallop(Index<RawData> from, Index<Everything> target) const {
+		tassert(this->sorted);
+
+		const size_t end = this->index;
+		size_t low = from;
+
+		// Slots removed since the join started are zeroed and break the order
+		// the search relies on, step over them one at a time instead.
+		if (!this->deletions.empty()) {
+			while (low < end && (this->indices[low] == 0 || this->indices[low].i < target.i)) {
+				low++;
+			}
+
+			return Index<RawData>{ low };
+		}
+
+		if (low >= end || this->indices[low].i >= target.i) {
+			return Index<RawData>{ low };
+		}
+
+		// Exponential search for an upper bound, then binary search inside it.
+		size_t step = 1;
+		size_t high = low + step;
+		while (high < end && this->indices[high].i < target.i) {
+			low = high;
+			step *= 2;
+			high = low + step;
+		}
+		high = std::min(high, end);
+
+		auto it = std::lower_bound(this->indices.begin() + low + 1, this->indices.begin() + high, target.i, [](Index<Everything> left, auto right) {
+			return left.i < right;
+		});
+
+		return Index<RawData>{ static_cast<size_t>(it - this->indices.begin()) };
+	}
+
+	inline bool RawData::isAlive(Index<RawData> i) const {
+		if (this->structInformation.storage == Storage::shared) {
+			return this->references[i] != 0;
+		}
+		else {
+			return this->indices[i] != 0;
+		}
+	}
+
+#ifdef LIB_SERIAL
+	inline bool RawData::print(serial::Serializer& serializer, Index<RawData> i) {
+		if (this->structInformation.storage == Storage::split) {
+			std::vector<std::byte> scratch(this->structInformation.width);
+			this->structInformation.load(*this, i, scratch.data());
+			const bool res = this->printObject(serializer, scratch.data());
+			this->structInformation.objectDestructor(scratch.data());
+			return res;
+		}
+
+		return this->printObject(serializer, this->getUntyped(i));
+	}
+
+	inline bool RawData::readObject(serial::Serializer& serializer, void* obj) {
+		if (this->structInformation.objectReader != nullptr) {
+			return this->structInformation.objectReader(serializer, obj);
+		}
+
+		// Bytes are only a valid object of a type that copies with memcpy.
+		tassert(this->structInformation.trivialCopy);
+
+		std::vector<std::byte> bytes{};
+		if (!serializer.read<std::vector<std::byte>>(std::move(bytes))) return false;
+		tassert(bytes.size() == this->structInformation.width);
+
+		std::memcpy(obj, bytes.data(), bytes.size());
+		return true;
+	}
+
+	inline bool RawData::writeObject(serial::Serializer& serializer, void* obj) {
+		if (this->structInformation.objectWriter != nullptr) {
+			return this->structInformation.objectWriter(serializer, obj);
+		}
+
+		tassert(this->structInformation.trivialCopy);
+
+		std::vector<std::byte> bytes(this->structInformation.width);
+		std::memcpy(bytes.data(), obj, bytes.size());
+		return serializer.write<std::vector<std::byte>>(std::move(bytes));
+	}
+
+	inline bool RawData::printObject(serial::Serializer& serializer, void* obj) {
+		if (this->structInformation.objectPrinter != nullptr) {
+			return this->structInformation.objectPrinter(serializer, obj);
+		}
+
+		std::vector<std::byte> bytes(this->structInformation.width);
+		std::memcpy(bytes.data(), obj, bytes.size());
+		return serializer.print<std::vector<std::byte>>(std::move(bytes));
+	}
+#endif
+
+	inline Index<RawData> RawData::cloneUntyped(Index<RawData> i, Index<Everything> j) {
+		tassert(0);
+		tassert(this->index > 1);
+		tassert(i > 0 && i <= this->index);
+		tassert(this->structInformation.clone != nullptr || this->structInformation.trivialCopy);
+		tassert(this->structInformation.width != 0);
+
+		if (this->index >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		this->appendIndex(j);
+
+		if (this->structInformation.storage == Storage::split) {
+			this->forColumns([&](std::vector<std::byte>& bytes, size_t width) {
+				std::memcpy(&bytes[this->index * width], &bytes[i * width], width);
+			});
+		}
+		else {
+			this->copyUntyped(this->getUntyped(i), this->getUntyped(this->index));
+			this->mirror(this->index);
+		}
+
+		return this->index++;
+	}
+
+	inline void RawData::swap(Index<RawData> i, Index<RawData> j) {
+		tassert(i != 0 && i < this->index);
+		tassert(j != 0 && j < this->index);
+
+		if (i == j) {
+			return;
+		}
+
+		this->forColumns([&](std::vector<std::byte>& bytes, size_t width) {
+			auto source = bytes.begin() + i * width;
+			std::swap_ranges(source, source + width, bytes.begin() + j * width);
+		});
+		std::swap(this->indices[i], this->indices[j]);
+		this->sorted = false;
+
+		// Slots that are removed but not yet packed have to keep matching their
+		// entry in the deletions.
+		if (this->indices[i] == 0 || this->indices[j] == 0) {
+			for (auto& deletion : this->deletions) {
+				if (deletion == i) {
+					deletion = j;
+				}
+				else if (deletion == j) {
+					deletion = i;
+				}
+			}
+		}
+	}
+
+	inline void RawData::permute(std::vector<Index<RawData>> const& order) {
+		tassert(order.size() == this->index);
+		tassert(this->deletions.empty());
+
+		this->sorted = false;
+
+		// Walks every cycle of the permutation once, save keeps the element of
+		// the first slot of the cycle aside and restore puts it in the last one.
+		auto followCycles = [&](auto save, auto move, auto restore) {
+			std::vector<bool> visited(order.size(), false);
+
+			for (Index<RawData> start{ 1 }; start < this->index; start++) {
+				if (visited[start] || order[start] == start) {
+					continue;
+				}
+
+				save(start);
+
+				auto j = start;
+				while (true) {
+					visited[j] = true;
+					auto next = order[j];
+
+					if (next == start) {
+						restore(j);
+						break;
+					}
+
+					move(next, j);
+					j = next;
+				}
+			}
+		};
+
+		this->forColumns([&](std::vector<std::byte>& bytes, size_t width) {
+			std::vector<std::byte> scratch(width);
+
+			followCycles(
+				[&](Index<RawData> start) {
+					std::copy_n(bytes.begin() + start * width, width, scratch.begin());
+				},
+				[&](Index<RawData> from, Index<RawData> to) {
+					std::copy_n(bytes.begin() + from * width, width, bytes.begin() + to * width);
+				},
+				[&](Index<RawData> to) {
+					std::copy(scratch.begin(), scratch.end(), bytes.begin() + to * width);
+				}
+			);
+		});
+
+		Index<Everything> startIndex{ 0 };
+
+		followCycles(
+			[&](Index<RawData> start) {
+				startIndex = this->indices[start];
+			},
+			[&](Index<RawData> from, Index<RawData> to) {
+				this->indices[to] = this->indices[from];
+			},
+			[&](Index<RawData> to) {
+				this->indices[to] = startIndex;
+			}
+		);
+	}
+
+	inline void RawData::cloneAtUntyped(Index<RawData> i, Index<Everything> j) {
+		tassert(this->structInformation.storage == Storage::dense);
+		tassert(this->structInformation.clone != nullptr || this->structInformation.trivialCopy);
+		tassert(this->indices[i] != 0);
+
+		while (j >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->indices[j] == 0);
+		this->copyUntyped(this->getUntyped(i), this->getUntyped(Index<RawData>{ j.i }));
+		this->indices[j] = j;
+		this->index.set(std::max<size_t>(this->index, j + 1));
+	}
+
+	inline void RawData::copyUntyped(void* source, void* target) {
+		if (this->structInformation.trivialCopy) {
+			std::memcpy(target, source, this->objectSize);
+		}
+		else {
+			this->structInformation.clone(source, target);
+		}
+	}
+
+	inline Index<RawData> RawData::relocateUntyped(RawData& source, Index<RawData> i, Index<Everything> j) {
+		if (this->reservedObjects == 0) {
+			this->initialize(source.structInformation);
+		}
+		else if (this->index >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->structInformation.storage == Storage::pool || this->structInformation.storage == Storage::split);
+		tassert(this->structInformation.index == source.structInformation.index);
+		tassert(source.isAlive(i));
+
+		this->appendIndex(j);
+
+		this->forColumns(source, [&](std::vector<std::byte>& bytes, std::vector<std::byte>& sourceBytes, size_t width) {
+			std::memcpy(&bytes[this->index * width], &sourceBytes[i * width], width);
+		});
+		if (this->structInformation.buffered && this->dirty[this->index] != std::byte{ 0 }) {
+			this->dirtyCount++;
+		}
+
+		source.indices[i].set(0);
+		source.deletions.push_back(i);
+
+		return this->index++;
+	}
+
+	inline void RawData::relocateAtUntyped(RawData& source, Index<RawData> i, Index<Everything> j) {
+		if (this->reservedObjects == 0) {
+			this->initialize(source.structInformation);
+		}
+
+		while (j >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->structInformation.storage == Storage::dense);
+		tassert(this->structInformation.index == source.structInformation.index);
+		tassert(source.indices[i] != 0);
+		tassert(this->indices[j] == 0);
+
+		std::memcpy(this->getUntyped(Index<RawData>{ j.i }), source.getUntyped(i), this->objectSize);
+		this->indices[j] = j;
+		this->index.set(std::max<size_t>(this->index, j + 1));
+
+		source.indices[i].set(0);
+	}
+
+	inline Index<RawData> RawData::append(RawData& source, IndexConverter<Everything, Everything> const& remap) {
+		tassert(source.deletions.empty());
+
+		if (source.reservedObjects == 0) {
+			return this->index;
+		}
+
+		if (this->reservedObjects == 0) {
+			this->initialize(source.structInformation);
+		}
+
+		tassert(this->structInformation.storage == Storage::pool || this->structInformation.storage == Storage::split);
+		tassert(this->structInformation.index == source.structInformation.index);
+
+		const Index<RawData> first = this->index;
+		const size_t count = source.index - 1;
+
+		this->reserve(first + count);
+
+		this->forColumns(source, [&](std::vector<std::byte>& bytes, std::vector<std::byte>& sourceBytes, size_t width) {
+			std::memcpy(&bytes[first * width], &sourceBytes[width], count * width);
+		});
+		this->dirtyCount += source.dirtyCount;
+
+		this->indices.reserve(first + count);
+		for (Index<RawData> i{ 1 }; i < source.index; i++) {
+			this->appendIndex(remap(source.indices[i]));
+		}
+
+		this->index.set(first + count);
+
+		source.indices.resize(1);
+		source.index.set(1);
+		source.sorted = true;
+
+		return first;
+	}
+
+	inline Index<RawData> RawData::internUntyped(void* value, StructInformation const& info) {
+		if (this->reservedObjects == 0) {
+			this->initialize(info);
+		}
+
+		tassert(this->structInformation.storage == Storage::shared);
+
+		auto hash = this->structInformation.hash(value);
+
+		auto [begin, end] = this->sharedLookup.equal_range(hash);
+		for (auto it = begin; it != end; it++) {
+			if (this->structInformation.equal(this->getUntyped(it->second), value)) {
+				this->references[it->second]++;
+				return it->second;
+			}
+		}
+
+		Index<RawData> slot{ 0 };
+		if (!this->freeSlots.empty()) {
+			slot = this->freeSlots.back();
+			this->freeSlots.pop_back();
+		}
+		else {
+			if (this->index >= this->reservedObjects) {
+				this->increaseSize();
+			}
+
+			this->indices.push_back(Index<Everything>{ 0 });
+			slot = this->index++;
+		}
+
+		this->copyUntyped(value, this->getUntyped(slot));
+		this->references[slot] = 1;
+		this->sharedLookup.insert({ hash, slot });
+
+		return slot;
+	}
+
+	template<class F>
+	inline void RawData::forColumns(F f) {
+		if (this->structInformation.storage == Storage::split) {
+			for (auto& column : this->columns) {
+				f(column.data, column.width);
+			}
+		}
+		else {
+			f(this->data, this->objectSize);
+		}
+
+		if (this->structInformation.buffered) {
+			f(this->front, this->objectSize);
+			f(this->dirty, 1);
+		}
+	}
+
+	template<class F>
+	inline void RawData::forColumns(RawData& other, F f) {
+		tassert(this->structInformation.index == other.structInformation.index);
+
+		if (this->structInformation.storage == Storage::split) {
+			for (size_t k = 0; k < this->columns.size(); k++) {
+				f(this->columns[k].data, other.columns[k].data, this->columns[k].width);
+			}
+		}
+		else {
+			f(this->data, other.data, this->objectSize);
+		}
+
+		if (this->structInformation.buffered) {
+			f(this->front, other.front, this->objectSize);
+			f(this->dirty, other.dirty, 1);
+		}
+	}
+
+	inline void RawData::markDirty(Index<RawData> i) {
+		tassert(this->structInformation.buffered);
+
+		if (this->dirty[i] == std::byte{ 0 }) {
+			this->dirty[i] = std::byte{ 1 };
+			this->dirtyCount++;
+		}
+	}
+
+	inline void RawData::mirror(Index<RawData> i) {
+		if (!this->structInformation.buffered) {
+			return;
+		}
+
+		std::memcpy(&this->front[i * this->objectSize], &this->data[i * this->objectSize], this->objectSize);
+
+		if (this->dirty[i] != std::byte{ 0 }) {
+			this->dirty[i] = std::byte{ 0 };
+			this->dirtyCount--;
+		}
+	}
+
+	inline void* RawData::getFrontUntyped(Index<RawData> i) {
+		tassert(this->structInformation.buffered);
+		tassert(i != 0);
+		tassert(i < this->reservedObjects);
+		return static_cast<void*>(&this->front[this->objectSize * i]);
+	}
+
+	inline void RawData::swapBuffers() {
+		tassert(this->structInformation.buffered);
+
+		std::swap(this->data, this->front);
+
+		if (this->dirtyCount == 0) {
+			return;
+		}
+
+		for (Index<RawData> i{ 1 }; i < this->index; i++) {
+			if (this->dirty[i] != std::byte{ 0 }) {
+				std::memcpy(&this->data[i * this->objectSize], &this->front[i * this->objectSize], this->objectSize);
+				this->dirty[i] = std::byte{ 0 };
+			}
+		}
+
+		this->dirtyCount = 0;
+	}
+
+	inline std::byte* RawData::getField(size_t field, Index<RawData> i) {
+		tassert(this->structInformation.storage == Storage::split);
+		tassert(i != 0);
+		tassert(i < this->reservedObjects);
+
+		auto& column = this->columns[field];
+		return &column.data[i * column.width];
+	}
+
+	template<auto member>
+	inline member_value_t<member>& RawData::field(Index<RawData> i) {
+		static_assert(field_index_v<member> < field_count_v<member_class_t<member>>, "not a field listed in component_fields");
+		return *reinterpret_cast<member_value_t<member>*>(this->getField(field_index_v<member>, i));
+	}
+
+	template<class T>
+	inline T RawData::load(Index<RawData> i) {
+		T res{};
+
+		std::apply([&](auto... members) {
+			size_t k = 0;
+			(std::memcpy(&(res.*members), this->getField(k++, i), sizeof(res.*members)), ...);
+		}, component_fields<T>::value);
+
+		return res;
+	}
+
+	template<class T>
+	inline void RawData::store(Index<RawData> i, T const& value) {
+		std::apply([&](auto... members) {
+			size_t k = 0;
+			(std::memcpy(this->getField(k++, i), &(value.*members), sizeof(value.*members)), ...);
+		}, component_fields<T>::value);
+	}
+
+	template<class T, class... Args>
+	inline Index<RawData> RawData::addSplit(Index<Everything> i, Args&&... args) {
+		if (this->reservedObjects == 0) {
+			this->initialize(LazyGlobal<StoredStructInformations>->get<T>());
+		}
+		else if (this->index >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->structInformation.storage == Storage::split);
+
+		this->appendIndex(i);
+		this->store<T>(this->index, T{ std::forward<Args>(args)... });
+
+		return this->index++;
+	}
+
+	inline void RawData::constructUntyped(void* target) {
+		if (this->structInformation.construct != nullptr) {
+			this->structInformation.construct(target);
+		}
+		else if (!this->structInformation.defaultValue.empty()) {
+			std::memcpy(target, this->structInformation.defaultValue.data(), this->structInformation.defaultValue.size());
+		}
+		else {
+			std::memset(target, 0, this->objectSize);
+		}
+	}
+
+	inline void RawData::initialize(StructInformation const& info) {
+		tassert(this->reservedObjects == 0);
+
+		this->structInformation = info;
+		this->objectSize = info.width;
+		this->reservedObjects = 16;
+		this->index.set(1);
+
+		if (info.storage == Storage::split) {
+			for (auto width : info.columnWidths) {
+				this->columns.push_back({ width, std::vector<std::byte>(this->reservedObjects * width) });
+			}
+		}
+		else {
+			this->data.resize(this->reservedObjects * info.width);
+		}
+
+		if (info.storage == Storage::dense) {
+			this->indices.resize(this->reservedObjects, Index<Everything>{ 0 });
+		}
+		else {
+			this->indices.push_back(Index<Everything>{ 0 });
+		}
+
+		if (info.storage == Storage::shared) {
+			this->references.resize(this->reservedObjects, 0);
+		}
+
+		if (info.buffered) {
+			this->front.resize(this->reservedObjects * info.width);
+			this->dirty.resize(this->reservedObjects, std::byte{ 0 });
+		}
+	}
+
+	inline std::pair<Index<RawData>, void*> RawData::addUntyped(Index<Everything> i, StructInformation const& info) {
+		if (this->reservedObjects == 0) {
+			this->initialize(info);
+		}
+		else if (this->index >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->structInformation.storage == Storage::pool);
+
+		this->appendIndex(i);
+
+		auto ptr = this->getUntyped(this->index);
+		this->constructUntyped(ptr);
+		this->mirror(this->index);
+
+		if (this->structInformation.buffered) {
+			this->markDirty(this->index);
+		}
+
+		return { Index<RawData>{ this->index++ }, ptr };
+	}
+
+	inline void* RawData::addAtUntyped(Index<Everything> i, StructInformation const& info) {
+		if (this->reservedObjects == 0) {
+			this->initialize(info);
+		}
+
+		while (i >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->structInformation.storage == Storage::dense);
+		tassert(this->indices[i] == 0);
+
+		this->indices[i] = i;
+		this->index.set(std::max<size_t>(this->index, i + 1));
+
+		auto ptr = this->getUntyped(Index<RawData>{ i.i });
+		this->constructUntyped(ptr);
+
+		return ptr;
+	}
+
+	inline void RawData::increaseSize() {
+		this->reserve(this->reservedObjects * 2);
+	}
+
+	inline void RawData::reserve(size_t objects) {
+		if (objects <= this->reservedObjects) {
+			return;
+		}
+
+		while (this->reservedObjects < objects) {
+			this->reservedObjects *= 2;
+		}
+
+		this->forColumns([&](std::vector<std::byte>& bytes, size_t width) {
+			bytes.resize(this->reservedObjects * width);
+		});
+
+		if (this->structInformation.storage == Storage::dense) {
+			this->indices.resize(this->reservedObjects, Index<Everything>{ 0 });
+		}
+		else if (this->structInformation.storage == Storage::shared) {
+			this->references.resize(this->reservedObjects, 0);
+		}
+	}
+
+	template<class T, class... Args>
+	inline Index<RawData> RawData::addShared(Args&&... args) {
+		this->objectSize = aligned_sizeof<T>::get();
+
+		if (this->reservedObjects == 0) {
+			this->initialize(LazyGlobal<StoredStructInformations>->get<T>());
+		}
+
+		tassert(this->structInformation.storage == Storage::shared);
+
+		T value{ std::forward<Args>(args)... };
+		auto hash = std::hash<T>()(value);
+
+		auto [begin, end] = this->sharedLookup.equal_range(hash);
+		for (auto it = begin; it != end; it++) {
+			if (this->get<T>(it->second) == value) {
+				this->references[it->second]++;
+				return it->second;
+			}
+		}
+
+		Index<RawData> slot{ 0 };
+		if (!this->freeSlots.empty()) {
+			slot = this->freeSlots.back();
+			this->freeSlots.pop_back();
+		}
+		else {
+			if (this->index >= this->reservedObjects) {
+				this->increaseSize();
+			}
+
+			this->indices.push_back(Index<Everything>{ 0 });
+			slot = this->index++;
+		}
+
+		new (&this->get<T>(slot)) T(std::move(value));
+		this->references[slot] = 1;
+		this->sharedLookup.insert({ hash, slot });
+
+		return slot;
+	}
+
+	inline void RawData::acquireShared(Index<RawData> i) {
+		tassert(this->references[i] != 0);
+		this->references[i]++;
+	}
+
+	inline void RawData::releaseShared(Index<RawData> i) {
+		tassert(this->references[i] != 0);
+
+		if (--this->references[i] != 0) {
+			return;
+		}
+
+		auto [begin, end] = this->sharedLookup.equal_range(this->structInformation.hash(this->getUntyped(i)));
+		for (auto it = begin; it != end; it++) {
+			if (it->second == i) {
+				this->sharedLookup.erase(it);
+				break;
+			}
+		}
+
+		this->structInformation.objectDestructor(this->getUntyped(i));
+		this->freeSlots.push_back(i);
+	}
+
+	template<class T, class... Args>
+	inline T* RawData::addAt(Index<Everything> i, Args&&... args) {
+		this->objectSize = aligned_sizeof<T>::get();
+
+		if (this->reservedObjects == 0) {
+			this->reservedObjects = 16;
+			this->index.set(1);
+			this->indices.resize(this->reservedObjects, Index<Everything>{ 0 });
+			this->data.resize(this->reservedObjects * aligned_sizeof<T>::get());
+
+			this->structInformation = LazyGlobal<StoredStructInformations>->get<T>();
+		}
+
+		while (i >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->structInformation.storage == Storage::dense);
+		tassert(this->indices[i] == 0);
+
+		this->indices[i] = i;
+		this->index.set(std::max<size_t>(this->index, i + 1));
+
+		auto& obj = this->get<T>(Index<RawData>{ i.i });
+
+		new (&obj) T{ std::forward<Args>(args)... };
+
+		return &obj;
+	}
+
+	template<class T, class... Args>
+	inline std::pair<Index<RawData>, T*> RawData::add(Index<Everything> i, Args&&... args) {
+		this->objectSize = aligned_sizeof<T>::get();
+
+		if (this->reservedObjects == 0) {
+			this->initialize(LazyGlobal<StoredStructInformations>->get<T>());
+		}
+		else if (this->index >= this->reservedObjects) {
+			this->increaseSize();
+		}
+
+		tassert(this->objectSize == aligned_sizeof<T>::get());
+		tassert(this->objectSize != 0);
+
+		this->appendIndex(i);
+
+		auto& obj = this->get<T>(this->index);
+
+		new (&obj) T{ std::forward<Args>(args)... };
+		this->mirror(this->index);
+
+		// New objects are usually set up through the returned reference.
+		if (this->structInformation.buffered) {
+			this->markDirty(this->index);
+		}
+
+		return { Index<RawData>{ this->index++ }, &obj };
+	}
+
+	inline void Everything::remove(Index<Everything> i) {
+		if (i == 0 || !this->isValidIndex(i)) {
+			return;
+		}
+
+		this->hierarchy.erase(i);
+
+		for (Index<OwningGroup> group{ 1 }; group < this->groups.size(); group++) {
+			this->leaveGroup(group, i);
+		}
+
+		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+			if (this->has(i, type)) {
+				switch (this->getStorage(type)) {
+					case Storage::pool:
+					case Storage::split:
+						this->data[type].removeUntyped(this->dataIndices[type][i]);
+						break;
+					case Storage::dense:
+						this->data[type].removeAtUntyped(Index<RawData>{ i.i });
+						break;
+					case Storage::shared:
+						this->data[type].releaseShared(this->dataIndices[type][i]);
+						break;
+					case Storage::tag:
+						break;
+				}
+
+				this->resetPresence(i, type);
+			}
+		}
+
+		this->signatures[i].reset();
+
+		this->qualifiers[i] = this->getNextQualifier();
+
+		tassert(std::ranges::find(this->removed, i) == this->removed.end());
+		this->removed.push_back(i);
+
+		tassert(this->validIndices[i]);
+		this->validIndices[i] = false;
+	}
+
+	inline void Everything::packDeletions(Index<Component> type) {
+		for (auto const& d : this->data[type].packDeletions()) {
+			this->dataIndices[type][d.changed] = d.i;
+		}
+	}
+
+	inline void Everything::collectRemoved() {
+		this->materialize();
+
+		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+			this->packDeletions(type);
+		}
+
+		if (!this->removed.empty()) {
+			for (auto& [id, pool] : this->relations) {
+				pool.purge(this->validIndices);
+			}
+		}
+
+		for (auto i : this->removed) {
+			tassert(this->signatures[i].none());
+			tassert(std::ranges::find(this->freeIndirections, i) == this->freeIndirections.end());
+			this->freeIndirections.push_back(i);
+		}
+
+		this->removed.clear();
+	}
+
+	inline void Everything::removeComponent(Index<Everything> i, Index<Component> type) {
+		tassert(this->signatures[i].test(type));
+		switch (this->getStorage(type)) {
+			case Storage::pool:
+			case Storage::split:
+				if (this->groupOwners[type] != 0) {
+					this->leaveGroup(this->groupOwners[type], i);
+				}
+				this->data[type].removeUntyped(this->dataIndices[type][i]);
+				break;
+			case Storage::dense:
+				this->data[type].removeAtUntyped(Index<RawData>{ i.i });
+				break;
+			case Storage::shared:
+				this->data[type].releaseShared(this->dataIndices[type][i]);
+				break;
+			case Storage::tag:
+				break;
+		}
+		this->signatures[i].reset(type);
+		this->resetPresence(i, type);
+	}
+
+	inline void Everything::removeAll(Index<Component> type) {
+		if (this->getStorage(type) == Storage::tag) {
+			for (auto& signature : this->signatures) {
+				signature.reset(type);
+			}
+			this->presence[type].clear();
+			this->counts[type] = 0;
+			return;
+		}
+		else if (this->getStorage(type) == Storage::shared) {
+			SignatureType signature{};
+			signature.set(type);
+			this->scan(signature, [&](Index<Everything> i) {
+				this->removeComponent(i, type);
+			});
+			return;
+		}
+
+		// Collected first, leaving an owning group moves slots around.
+		std::vector<Index<Everything>> owners{};
+		for (size_t i = 1; i < this->data[type].indices.size(); i++) {
+			auto index = this->data[type].indices[i];
+			if (index != 0 && this->has(index, type)) {
+				owners.push_back(index);
+			}
+		}
+
+		for (auto index : owners) {
+			this->removeComponent(index, type);
+		}
+	}
+
+	inline RawData& Everything::gets(Index<Component> type) {
+		return this->data[type];
+	}
+
+#ifdef LIB_SERIAL
+	inline bool Everything::print(serial::Serializer& serializer, Index<Everything> index, Index<Component> type) {
+		return this->data[type].print(serializer, this->dataIndices[type][index]);
+	}
+#endif
+
+	inline bool Everything::has(Index<Everything> i, Index<Component> type) const {
+		return this->signatures[i].test(type);
+	}
+
+	inline Index<RawData> Everything::getComponentIndex(Index<Everything> i, Index<Component> type) const {
+		tassert(this->has(i, type));
+		return this->dataIndices[type][i];
+	}
+
+	inline size_t Everything::getTypeCount() {
+		return LazyGlobal<ComponentCounter>->size();
+	}
+
+	inline Storage Everything::getStorage(Index<Component> type) const {
+		return LazyGlobal<StoredStructInformations>->indexed[type].storage;
+	}
+
+	inline DynamicQuery::DynamicQuery(std::vector<Index<Component>> required_, std::vector<Index<Component>> excluded_) :
+		required(std::move(required_)),
+		excluded(std::move(excluded_)) {
+		for (auto type : this->required) {
+			this->filter.with.set(type);
+
+			if (LazyGlobal<StoredStructInformations>->indexed[type].storage == Storage::pool) {
+				this->pooled.push_back(type);
+			}
+		}
+
+		for (auto type : this->excluded) {
+			this->filter.without.set(type);
+		}
+
+		this->filter.mask = this->filter.with | this->filter.without;
+		this->id = LazyGlobal<Ids>->get(this->filter);
+	}
+
+	inline size_t DynamicQuery::Ids::get(QueryFilter const& filter) {
+		std::scoped_lock lock(this->mutex);
+
+		auto& candidates = this->byFilter[filter.with];
+
+		auto it = std::ranges::find_if(candidates, [&](auto const& candidate) {
+			return candidate.first == filter.without;
+		});
+
+		if (it != candidates.end()) {
+			return it->second;
+		}
+
+		const size_t res = LazyGlobal<Everything::QueryCounter>->increment();
+		candidates.push_back({ filter.without, res });
+		return res;
+	}
+
+	inline void* Everything::getUntyped(Index<Everything> i, Index<Component> type) {
+		tassert(this->has(i, type));
+
+		switch (this->getStorage(type)) {
+			case Storage::pool:
+				if (this->data[type].structInformation.buffered) {
+					this->data[type].markDirty(this->dataIndices[type][i]);
+				}
+				return this->data[type].getUntyped(this->dataIndices[type][i]);
+			case Storage::shared:
+				return this->data[type].getUntyped(this->dataIndices[type][i]);
+			case Storage::dense:
+				return this->data[type].getUntyped(Index<RawData>{ i.i });
+			case Storage::tag:
+			case Storage::split:
+				return nullptr;
+		}
+
+		return nullptr;
+	}
+
+	inline Index<Component> Everything::registerComponent(ComponentDescriptor const& descriptor) {
+		tassert(LazyGlobal<ComponentCounter>->size() < SIZE);
+		tassert(descriptor.size != 0);
+		tassert(std::has_single_bit(descriptor.alignment));
+		// Pools are byte vectors, their buffers are only aligned this far.
+		tassert(descriptor.alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+		tassert(descriptor.storage == Storage::pool || descriptor.storage == Storage::dense);
+		tassert(descriptor.defaultValue.empty() || descriptor.defaultValue.size() == descriptor.size);
+
+		for ([[maybe_unused]] auto const& field : descriptor.fields) {
+			tassert(field.offset + field.size <= descriptor.size);
+		}
+
+		const size_t alignment = std::max<size_t>(8, descriptor.alignment);
+
+		StructInformation info;
+		info.name = descriptor.name;
+		info.index = LazyGlobal<ComponentCounter>->increment();
+		info.width = (descriptor.size + alignment - 1) / alignment * alignment;
+		info.storage = descriptor.storage;
+		info.construct = descriptor.construct;
+		info.defaultValue = descriptor.defaultValue;
+		info.fields = descriptor.fields;
+
+		if (descriptor.destruct != nullptr) {
+			info.objectDestructor = descriptor.destruct;
+		}
+		else {
+			info.objectDestructor = [](void*) {};
+		}
+
+		if (descriptor.copy != nullptr) {
+			info.clone = descriptor.copy;
+		}
+		else {
+			info.trivialCopy = true;
+		}
+
+#ifdef LIB_SERIAL
+		LazyGlobal<StoredStructInformations>->infos.insert({ info.name, info });
+#else
+		LazyGlobal<StoredStructInformations>->infos.insert({ info.index, info });
+#endif
+		LazyGlobal<StoredStructInformations>->indexed[info.index] = info;
+
+		return info.index;
+	}
+
+	inline void* Everything::addUntyped(Index<Everything> i, Index<Component> type) {
+		tassert(!this->has(i, type));
+
+		auto const& info = LazyGlobal<StoredStructInformations>->indexed[type];
+		tassert(info.index == type);
+
+		// Types registered at runtime can be newer than the objects of the
+		// world, make only grows the tables of the types there were.
+		if (this->dataIndices[type].size() < this->signatures.size()) {
+			this->dataIndices[type].resize(this->signatures.size(), Index<RawData>{ 0 });
+		}
+
+		void* ptr = nullptr;
+
+		switch (info.storage) {
+			case Storage::pool:
+			{
+				auto [index, p] = this->data[type].addUntyped(i, info);
+				this->dataIndices[type][i] = index;
+				ptr = p;
+				break;
+			}
+			case Storage::dense:
+				ptr = this->data[type].addAtUntyped(i, info);
+				this->dataIndices[type][i] = Index<RawData>{ i.i };
+				break;
+			case Storage::tag:
+			case Storage::shared:
+			case Storage::split:
+				tassert(0);
+				return nullptr;
+		}
+
+		this->signatures[i].set(type);
+		this->setPresence(i, type);
+
+		if (auto group = this->groupOwners[type]; group != 0) {
+			this->enterGroup(group, i);
+			return this->getUntyped(i, type);
+		}
+
+		return ptr;
+	}
+
+	inline void* Everything::getField(Index<Everything> i, Index<Component> type, std::string_view name) {
+		auto const& fields = LazyGlobal<StoredStructInformations>->indexed[type].fields;
+
+		auto it = std::ranges::find(fields, name, &ComponentField::name);
+		if (it == fields.end()) {
+			return nullptr;
+		}
+
+		return static_cast<std::byte*>(this->getUntyped(i, type)) + it->offset;
+	}
+
+	template<class F>
+	inline bool Everything::match(QueryCursor& cursor, QueryBudget const& budget, F f) {
+		using arguments_list = te::map_t<
+			te::type_function_t<query_term_t>,
+			te::arguments_list_t<F>
+		>;
+
+		return MatchExpanded<arguments_list>::runCursor(*this, f, cursor, budget);
+	}
+
+	template<class F>
+	inline void Everything::match(DynamicQuery const& query, F f) {
+		tassert(query.required.size() <= SIZE);
+
+		// Kept alive, f is allowed to run queries that replace the cached plan.
+		const std::shared_ptr<QueryPlan> plan = this->plan(query.id, query.filter, query.pooled);
+
+		std::array<void*, SIZE> components{};
+		const std::span<void* const> span(components.data(), query.required.size());
+
+		this->execute(*plan, query.pooled, [&](Index<Everything> i) {
+			for (size_t k = 0; k < query.required.size(); k++) {
+				components[k] = this->getUntyped(i, query.required[k]);
+			}
+
+			f(WeakObject{ i, this }, span);
+		});
+	}
+
+	template<class F>
+	inline void Everything::execute(QueryPlan const& plan, std::span<Index<Component> const> pooled, F f) {
+		auto const& query = plan.filter;
+
+		auto walk = [&](RawData& pool, Index<RawData> end) {
+			for (Index<RawData> i{ 1 }; i < end; i++) {
+				auto index = pool.getIndex(i);
+
+				if (index != 0 && query.test(this->signatures[index])) {
+					f(index);
+				}
+			}
+		};
+
+		switch (plan.strategy) {
+			case Strategy::group:
+			{
+				auto const& group = this->groups[plan.group];
+				walk(this->gets(group.pivot), Index<RawData>{ group.size + 1 });
+				break;
+			}
+			case Strategy::merge:
+				this->mergeJoin(pooled, [&](Index<Everything> index, std::span<Index<RawData> const>) {
+					if (query.test(this->signatures[index])) {
+						f(index);
+					}
+				});
+				break;
+			case Strategy::pivot:
+			case Strategy::prefetch:
+				walk(this->gets(plan.pivot), this->gets(plan.pivot).index);
+				break;
+			case Strategy::bitmap:
+				this->scan(query.with, query.without, [&](Index<Everything> index) {
+					if (query.anyOf.empty() || query.test(this->signatures[index])) {
+						f(index);
+					}
+				});
+				break;
+		}
+	}
+
+	inline Everything::Everything() {
+		for (Index<Component> type{ 0 }; type < SIZE; type++) {
+			this->dataIndices[type].push_back(Index<RawData>{ 0 });
+		}
+	}
+
+	template<class... Ms>
+	inline UniqueObject Everything::clone(WeakObject const& obj) {
+		std::vector<Index<Component>> components;
+
+		for (auto component : { Everything::component_index_v<Ms>... }) {
+			components.push_back(component);
+		}
+
+		return this->clone(components, obj);
+	}
+
+	template<class T>
+	inline void Everything::removeComponent(Index<Everything> i) {
+		this->removeComponent(i, component_index_v<T>);
+	}
+
+	template<class T>
+	inline void Everything::removeAll() {
+		this->removeAll(component_index_v<T>);
+	}
+
+	template<class T, class... Args>
+	inline component_reference_t<T> Everything::add(Index<Everything> i, Args&&... args) {
+		tassert(!this->has<T>(i));
+		if constexpr (storage_policy_v<T> == Storage::tag) {
+			this->signatures[i].set(component_index_v<T>);
+			this->setPresence(i, component_index_v<T>);
+			return LazyGlobal<T, Everything>.get();
+		}
+		else if constexpr (storage_policy_v<T> == Storage::dense) {
+			auto ptr = this->data[component_index_v<T>].template addAt<T>(i, std::forward<Args>(args)...);
+			this->dataIndices[component_index_v<T>][i] = Index<RawData>{ i.i };
+			this->signatures[i].set(component_index_v<T>);
+			this->setPresence(i, component_index_v<T>);
+			return *ptr;
+		}
+		else if constexpr (storage_policy_v<T> == Storage::shared) {
+			auto index = this->data[component_index_v<T>].template addShared<T>(std::forward<Args>(args)...);
+			this->dataIndices[component_index_v<T>][i] = index;
+			this->signatures[i].set(component_index_v<T>);
+			this->setPresence(i, component_index_v<T>);
+			return this->data[component_index_v<T>].template get<T>(index);
+		}
+		else if constexpr (storage_policy_v<T> == Storage::split) {
+			auto index = this->data[component_index_v<T>].template addSplit<T>(i, std::forward<Args>(args)...);
+			this->dataIndices[component_index_v<T>][i] = index;
+			this->signatures[i].set(component_index_v<T>);
+			this->setPresence(i, component_index_v<T>);
+			return this->get<T>(i);
+		}
+
+		auto [index, ptr] = this->data[component_index_v<T>].template add<T>(i, std::forward<Args>(args)...);
+		this->dataIndices[component_index_v<T>][i] = index;
+		this->signatures[i].set(component_index_v<T>);
+		this->setPresence(i, component_index_v<T>);
+
+		if (auto group = this->groupOwners[component_index_v<T>]; group != 0) {
+			this->enterGroup(group, i);
+			return this->get<T>(i);
+		}
+
+		return *ptr;
+	}
+
+	template<class T, class... Args>
+	inline component_reference_t<T> Everything::replaceShared(Index<Everything> i, Args&&... args) {
+		static_assert(storage_policy_v<T> == Storage::shared);
+		tassert(this->has<T>(i));
+
+		const auto type = component_index_v<T>;
+		auto& pool = this->data[type];
+
+		auto slot = pool.template addShared<T>(std::forward<Args>(args)...);
+		pool.releaseShared(this->dataIndices[type][i]);
+		this->dataIndices[type][i] = slot;
+
+		this->reindex(i, type);
+		return pool.template get<T>(slot);
+	}
+
+	template<class T>
+	inline component_reference_t<T> Everything::get(Index<Everything> i) {
+		if constexpr (storage_policy_v<T> == Storage::tag) {
+			return LazyGlobal<T, Everything>.get();
+		}
+		else if constexpr (storage_policy_v<T> == Storage::dense) {
+			return this->data[component_index_v<T>].template get<T>(Index<RawData>{ i.i });
+		}
+		else if constexpr (storage_policy_v<T> == Storage::split) {
+			return this->data[component_index_v<T>].template load<T>(this->dataIndices[component_index_v<T>][i]);
+		}
+
+		auto& pool = this->data[component_index_v<T>];
+		auto slot = this->dataIndices[component_index_v<T>][i];
+
+		if constexpr (double_buffered_v<T>) {
+			pool.markDirty(slot);
+		}
+
+		return pool.template get<T>(slot);
+	}
+
+	template<class T>
+	inline T const& Everything::getPrevious(Index<Everything> i) {
+		static_assert(double_buffered_v<T>);
+		tassert(this->has<T>(i));
+
+		auto& pool = this->data[component_index_v<T>];
+		return *reinterpret_cast<T const*>(pool.getFrontUntyped(this->dataIndices[component_index_v<T>][i]));
+	}
+
+	inline void Everything::swapBuffers() {
+		for (auto& pool : this->data) {
+			if (pool.structInformation.buffered && pool.reservedObjects != 0) {
+				pool.swapBuffers();
+			}
+		}
+	}
+
+	template<class T>
+	inline void Everything::swapBuffers() {
+		static_assert(double_buffered_v<T>);
+
+		auto& pool = this->data[component_index_v<T>];
+		if (pool.reservedObjects != 0) {
+			pool.swapBuffers();
+		}
+	}
+
+	template<auto member>
+	inline member_value_t<member>& Everything::field(Index<Everything> i) {
+		using T = member_class_t<member>;
+		static_assert(storage_policy_v<T> == Storage::split);
+
+		tassert(this->has<T>(i));
+		return this->data[component_index_v<T>].template field<member>(this->dataIndices[component_index_v<T>][i]);
+	}
+
+	template<auto member>
+	inline std::span<member_value_t<member>> Everything::fieldSpan() {
+		using T = member_class_t<member>;
+		static_assert(storage_policy_v<T> == Storage::split);
+
+		const auto type = component_index_v<T>;
+		this->packDeletions(type);
+
+		auto& pool = this->data[type];
+		if (pool.index <= 1) {
+			return {};
+		}
+
+		return { &pool.template field<member>(Index<RawData>{ 1 }), pool.index - 1 };
+	}
+
+	template<class T>
+	inline std::span<Index<Everything> const> Everything::slotEntities() {
+		const auto type = component_index_v<T>;
+		this->packDeletions(type);
+
+		auto& pool = this->data[type];
+		if (pool.index <= 1) {
+			return {};
+		}
+
+		return { pool.indices.data() + 1, pool.index - 1 };
+	}
+
+	template<auto... members, class F>
+	inline void Everything::matchFields(F f) {
+		using T = te::head_t<te::list_type<member_class_t<members>...>>;
+		static_assert((std::same_as<T, member_class_t<members>> && ...), "all fields have to belong to the same component");
+
+		auto entities = this->slotEntities<T>();
+		f(entities, this->fieldSpan<members>()...);
+	}
+
+	template<class T>
+	inline RawData& Everything::gets() {
+		return this->gets(component_index_v<T>);
+	}
+
+	inline void Everything::applyOrder(Index<Component> type, std::vector<Index<RawData>> const& order) {
+		auto& pool = this->data[type];
+		pool.permute(order);
+
+		for (Index<RawData> i{ 1 }; i < pool.index; i++) {
+			this->dataIndices[type][pool.getIndex(i)] = i;
+		}
+	}
+
+	template<class T, class F>
+	inline void Everything::sort(F compare) {
+		static_assert(storage_policy_v<T> == Storage::pool);
+
+		const auto type = component_index_v<T>;
+		this->packDeletions(type);
+
+		auto& pool = this->data[type];
+		if (pool.index <= 1) {
+			return;
+		}
+
+		std::vector<Index<RawData>> order(pool.index);
+		for (Index<RawData> i{ 0 }; i < pool.index; i++) {
+			order[i] = i;
+		}
+
+		auto less = [&](Index<RawData> left, Index<RawData> right) {
+			return compare(std::as_const(pool.template get<T>(left)), std::as_const(pool.template get<T>(right)));
+		};
+
+		auto group = this->groupOwners[type];
+		size_t groupSize = group != 0 ? this->groups[group].size : 0;
+
+		std::sort(order.begin() + 1, order.begin() + 1 + groupSize, less);
+		std::sort(order.begin() + 1 + groupSize, order.end(), less);
+
+		if (group != 0) {
+			for (Index<Component> other{ 0 }; other < this->getTypeCount(); other++) {
+				if (other == type || !this->groups[group].signature.test(other)) {
+					continue;
+				}
+
+				auto& otherPool = this->data[other];
+				this->packDeletions(other);
+
+				std::vector<Index<RawData>> otherOrder(otherPool.index);
+				for (Index<RawData> i{ 0 }; i < otherPool.index; i++) {
+					otherOrder[i] = i;
+				}
+				for (size_t i = 1; i <= groupSize; i++) {
+					otherOrder[i] = this->dataIndices[other][pool.getIndex(order[i])];
+				}
+
+				this->applyOrder(other, otherOrder);
+			}
+		}
+
+		this->applyOrder(type, order);
+	}
+
+	template<class T>
+	inline void Everything::sortByEntity() {
+		static_assert(storage_policy_v<T> == Storage::pool);
+
+		const auto type = component_index_v<T>;
+		this->packDeletions(type);
+
+		auto& pool = this->data[type];
+		if (pool.index <= 1) {
+			return;
+		}
+
+		tassert(this->groupOwners[type] == 0);
+
+		std::vector<Index<RawData>> order(pool.index);
+		for (Index<RawData> i{ 0 }; i < pool.index; i++) {
+			order[i] = i;
+		}
+
+		std::sort(order.begin() + 1, order.end(), [&](Index<RawData> left, Index<RawData> right) {
+			return pool.getIndex(left).i < pool.getIndex(right).i;
+		});
+
+		this->applyOrder(type, order);
+		pool.sorted = true;
+	}
+
+	template<class T, class Lead>
+	inline void Everything::sortLike() {
+		static_assert(storage_policy_v<T> == Storage::pool);
+		static_assert(storage_policy_v<Lead> == Storage::pool);
+
+		const auto type = component_index_v<T>;
+		const auto lead = component_index_v<Lead>;
+		tassert(this->groupOwners[type] == 0);
+
+		this->packDeletions(type);
+		this->packDeletions(lead);
+
+		auto& pool = this->data[type];
+		auto& leadPool = this->data[lead];
+		if (pool.index <= 1) {
+			return;
+		}
+
+		std::vector<Index<RawData>> order{ Index<RawData>{ 0 } };
+		order.reserve(pool.index);
+
+		for (Index<RawData> i{ 1 }; i < leadPool.index; i++) {
+			auto index = leadPool.getIndex(i);
+			if (this->has(index, type)) {
+				order.push_back(this->dataIndices[type][index]);
+			}
+		}
+
+		for (Index<RawData> i{ 1 }; i < pool.index; i++) {
+			if (!this->has(pool.getIndex(i), lead)) {
+				order.push_back(i);
+			}
+		}
+
+		this->applyOrder(type, order);
+	}
+
+	template<class... Ts>
+	inline Index<OwningGroup> Everything::group() {
+		static_assert(sizeof...(Ts) != 0);
+		static_assert(((storage_policy_v<Ts> == Storage::pool) && ...), "only pooled components can be owned by a group");
+
+		Index<OwningGroup> res{ this->groups.size() };
+
+		OwningGroup group{};
+		group.signature = group_signature_v<Ts...>;
+		group.pivot = component_index_v<typename te::head_t<te::list_type<Ts...>>>;
+		this->groups.push_back(group);
+
+		for (auto type : { component_index_v<Ts>... }) {
+			tassert(this->groupOwners[type] == 0);
+			this->groupOwners[type] = res;
+		}
+
+		this->scan(group.signature, [&](Index<Everything> i) {
+			this->enterGroup(res, i);
+		});
+
+		return res;
+	}
+
+	template<class... Ms>
+	inline OwningGroup const* Everything::selectGroup() const {
+		std::array<Index<Component>, sizeof...(Ms)> pooled{};
+		size_t count = 0;
+		for (auto [s, storage] : { std::make_pair(Everything::component_index_v<Ms>, storage_policy_v<Ms>)... }) {
+			if (storage == Storage::pool) {
+				pooled[count++] = s;
+			}
+		}
+		return this->selectGroup(std::span(pooled.data(), count));
+	}
+
+	inline OwningGroup const* Everything::selectGroup(std::span<Index<Component> const> pooled) const {
+		if (pooled.empty()) {
+			return nullptr;
+		}
+
+		SignatureType signature{};
+		for (auto s : pooled) {
+			signature.set(s);
+		}
+
+		for (Index<OwningGroup> group{ 1 }; group < this->groups.size(); group++) {
+			if (this->groups[group].signature == signature) {
+				return &this->groups[group];
+			}
+		}
+
+		return nullptr;
+	}
+
+	inline void Everything::enterGroup(Index<OwningGroup> group, Index<Everything> i) {
+		auto& g = this->groups[group];
+
+		if ((this->signatures[i] & g.signature) != g.signature) {
+			return;
+		}
+
+		Index<RawData> target{ g.size + 1 };
+		tassert(this->dataIndices[g.pivot][i] >= target);
+
+		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+			if (!g.signature.test(type)) {
+				continue;
+			}
+
+			auto& pool = this->data[type];
+			auto source = this->dataIndices[type][i];
+			auto other = pool.getIndex(target);
+
+			pool.swap(source, target);
+
+			this->dataIndices[type][i] = target;
+			if (other != 0) {
+				this->dataIndices[type][other] = source;
+			}
+		}
+
+		g.size++;
+	}
+
+	inline void Everything::leaveGroup(Index<OwningGroup> group, Index<Everything> i) {
+		auto& g = this->groups[group];
+
+		if ((this->signatures[i] & g.signature) != g.signature) {
+			return;
+		}
+
+		Index<RawData> target{ g.size };
+		tassert(this->dataIndices[g.pivot][i] <= target);
+
+		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+			if (!g.signature.test(type)) {
+				continue;
+			}
+
+			auto& pool = this->data[type];
+			auto source = this->dataIndices[type][i];
+			auto other = pool.getIndex(target);
+
+			pool.swap(source, target);
+
+			this->dataIndices[type][i] = target;
+			this->dataIndices[type][other] = source;
+		}
+
+		g.size--;
+	}
+
+	template<class... Ts>
+	inline bool Everything::has(Index<Everything> i) const {
+		static_assert(sizeof...(Ts) != 0);
+		if constexpr (sizeof...(Ts) == 1) {
+			return this->signatures[i].test(Everything::component_index_v<typename te::head_t<te::list_type<Ts...>>>);
+		}
+		else {
+			auto const sig = group_signature_v<Ts...>;
+			return (this->signatures[i] & sig) == sig;
+		}
+	}
+
+	template<class F>
+	inline void Everything::run(F f) {
+		Loop::run(*this, f);
+	}
+
+	template<class F>
+	inline void Everything::match(F f) {
+		using arguments_list = te::map_t<
+			te::type_function_t<query_term_t>,
+			te::arguments_list_t<F>
+		>;
+
+		MatchExpanded<arguments_list>::run(*this, f);
+	}
+
+	template<class F>
+	inline QueryPlan const& Everything::preparePlan() {
+		using arguments_list = te::map_t<
+			te::type_function_t<query_term_t>,
+			te::arguments_list_t<F>
+		>;
+
+		return MatchExpanded<arguments_list>::prepare(*this);
+	}
+
+	template<class F>
+	inline void Everything::adoptPlan(QueryPlan const& plan) {
+		using arguments_list = te::map_t<
+			te::type_function_t<query_term_t>,
+			te::arguments_list_t<F>
+		>;
+
+		MatchExpanded<arguments_list>::adopt(*this, plan);
+	}
+
+	inline void Everything::adoptPlan(size_t id, QueryPlan const& plan, std::span<Index<Component> const> pooled) {
+		std::unique_lock lock(this->plansMutex.mutex);
+
+		auto it = this->plans.find(id);
+
+		if (it != this->plans.end() && !this->isStale(*it->second, pooled)) {
+			return;
+		}
+
+		if (this->isStale(plan, pooled)) {
+			return;
+		}
+
+		if (it == this->plans.end()) {
+			this->plans.insert({ id, std::make_shared<QueryPlan>(plan) });
+		}
+		else {
+			it->second = std::make_shared<QueryPlan>(plan);
+		}
+	}
+
+	inline void Everything::setPresence(Index<Everything> i, Index<Component> type) {
+		auto& bitmap = this->presence[type];
+		const size_t word = i / 64;
+
+		if (word >= bitmap.size()) {
+			bitmap.resize(word + 1, 0);
+		}
+
+		const auto bit = uint64_t(1) << (i % 64);
+		this->counts[type] += (bitmap[word] & bit) == 0;
+		bitmap[word] |= bit;
+
+		this->reindex(i, type);
+	}
+
+	inline void Everything::resetPresence(Index<Everything> i, Index<Component> type) {
+		auto& bitmap = this->presence[type];
+		const size_t word = i / 64;
+
+		if (word < bitmap.size()) {
+			const auto bit = uint64_t(1) << (i % 64);
+			this->counts[type] -= (bitmap[word] & bit) != 0;
+			bitmap[word] &= ~bit;
+		}
+
+		if (this->indexedTypes.test(type)) {
+			for (auto& [id, index] : this->fieldIndexes) {
+				if (index.type == type) {
+					index.erase(index.entries.get(), i);
+				}
+			}
+		}
+	}
+
+	template<auto member, Lookup lookup>
+	inline void FieldEntries<member, lookup>::insert(Index<Everything> i, value_type const& value) {
+		this->erase(i);
+		this->values.insert({ i, value });
+
+		if constexpr (lookup == Lookup::hash) {
+			this->entities[value].push_back(i);
+		}
+		else {
+			this->entities.insert({ value, i });
+		}
+	}
+
+	template<auto member, Lookup lookup>
+	inline void FieldEntries<member, lookup>::erase(Index<Everything> i) {
+		auto it = this->values.find(i);
+		if (it == this->values.end()) {
+			return;
+		}
+
+		if constexpr (lookup == Lookup::hash) {
+			auto bucket = this->entities.find(it->second);
+			auto& indices = bucket->second;
+
+			*std::ranges::find(indices, i) = indices.back();
+			indices.pop_back();
+
+			if (indices.empty()) {
+				this->entities.erase(bucket);
+			}
+		}
+		else {
+			this->entities.erase({ it->second, i });
+		}
+
+		this->values.erase(it);
+	}
+
+	template<auto member, Lookup lookup>
+	inline size_t Everything::fieldIndexId() {
+		static const size_t res = LazyGlobal<Everything::QueryCounter>->increment();
+		return res;
+	}
+
+	template<auto member, Lookup lookup>
+	inline void Everything::indexField() {
+		using T = member_class_t<member>;
+		using Entries = FieldEntries<member, lookup>;
+		static_assert(storage_policy_v<T> != Storage::tag);
+
+		const auto id = fieldIndexId<member, lookup>();
+		if (this->fieldIndexes.contains(id)) {
+			return;
+		}
+
+		FieldIndex index{};
+		index.type = component_index_v<T>;
+		index.entries = { new Entries(), [](void* entries) {
+			delete reinterpret_cast<Entries*>(entries);
+		} };
+
+		index.insert = [](Everything& e, void* entries, Index<Everything> i) {
+			auto const type = component_index_v<T>;
+			auto& pool = e.data[type];
+			auto slot = e.dataIndices[type][i];
+
+			if constexpr (storage_policy_v<T> == Storage::split) {
+				reinterpret_cast<Entries*>(entries)->insert(i, pool.template field<member>(slot));
+			}
+			else {
+				reinterpret_cast<Entries*>(entries)->insert(i, pool.template get<T>(slot).*member);
+			}
+		};
+
+		index.erase = [](void* entries, Index<Everything> i) {
+			reinterpret_cast<Entries*>(entries)->erase(i);
+		};
+
+		index.clear = [](void* entries) {
+			*reinterpret_cast<Entries*>(entries) = Entries();
+		};
+
+		SignatureType signature{};
+		signature.set(index.type);
+		this->scan(signature, [&](Index<Everything> i) {
+			index.insert(*this, index.entries.get(), i);
+		});
+
+		this->indexedTypes.set(index.type);
+		this->fieldIndexes.insert({ id, std::move(index) });
+	}
+
+	inline void Everything::rebuildFieldIndexes() {
+		for (auto& [id, index] : this->fieldIndexes) {
+			index.clear(index.entries.get());
+
+			SignatureType signature{};
+			signature.set(index.type);
+			this->scan(signature, [&](Index<Everything> i) {
+				index.insert(*this, index.entries.get(), i);
+			});
+		}
+	}
+
+	template<auto member, Lookup lookup>
+	inline bool Everything::hasFieldIndex() const {
+		return this->fieldIndexes.contains(fieldIndexId<member, lookup>());
+	}
+
+	template<auto member, Lookup lookup>
+	inline std::optional<WeakObject> Everything::findOne(member_value_t<member> const& value) {
+		std::optional<WeakObject> res{};
+
+		this->find<member, lookup>(value, [&](WeakObject obj) {
+			if (!res.has_value()) {
+				res = obj;
+			}
+		});
+
+		return res;
+	}
+
+	template<auto member, Lookup lookup, class F>
+	inline void Everything::find(member_value_t<member> const& value, F f) {
+		auto it = this->fieldIndexes.find(fieldIndexId<member, lookup>());
+		tassert(it != this->fieldIndexes.end());
+
+		auto& entities = reinterpret_cast<FieldEntries<member, lookup>*>(it->second.entries.get())->entities;
+
+		if constexpr (lookup == Lookup::hash) {
+			auto bucket = entities.find(value);
+			if (bucket == entities.end()) {
+				return;
+			}
+
+			for (auto i : bucket->second) {
+				f(WeakObject{ i, this });
+			}
+		}
+		else {
+			for (auto entry = entities.lower_bound({ value, Index<Everything>{ 0 } }); entry != entities.end() && !(value < entry->first); entry++) {
+				f(WeakObject{ entry->second, this });
+			}
+		}
+	}
+
+	template<auto member, class F>
+	inline void Everything::findRange(member_value_t<member> const& lo, member_value_t<member> const& hi, F f) {
+		auto it = this->fieldIndexes.find(fieldIndexId<member, Lookup::ordered>());
+		tassert(it != this->fieldIndexes.end());
+
+		auto& entities = reinterpret_cast<FieldEntries<member, Lookup::ordered>*>(it->second.entries.get())->entities;
+
+		for (auto entry = entities.lower_bound({ lo, Index<Everything>{ 0 } }); entry != entities.end() && entry->first < hi; entry++) {
+			f(WeakObject{ entry->second, this });
+		}
+	}
+
+	template<class T, class F>
+	inline void Everything::modify(Index<Everything> i, F f) {
+		static_assert(storage_policy_v<T> != Storage::tag);
+		static_assert(storage_policy_v<T> != Storage::shared, "shared values are changed by replacing them");
+		tassert(this->has<T>(i));
+
+		if constexpr (storage_policy_v<T> == Storage::split) {
+			T value = this->get<T>(i);
+			f(value);
+			this->data[component_index_v<T>].template store<T>(this->dataIndices[component_index_v<T>][i], value);
+		}
+		else {
+			f(this->get<T>(i));
+		}
+
+		this->reindex(i, component_index_v<T>);
+	}
+
+	inline void Everything::reindex(Index<Everything> i, Index<Component> type) {
+		if (this->indexedTypes.test(type)) {
+			for (auto& [id, index] : this->fieldIndexes) {
+				if (index.type == type) {
+					index.insert(*this, index.entries.get(), i);
+				}
+			}
+		}
+	}
+
+	inline Hierarchy::Slot& Hierarchy::slot(Index<Everything> i) {
+		if (i >= this->slots.size()) {
+			this->slots.resize(i + 1);
+		}
+
+		return this->slots[i];
+	}
+
+	inline void Hierarchy::append(Index<Everything> i, Index<Everything> parent, size_t depth) {
+		if (depth >= this->levels.size()) {
+			this->levels.resize(depth + 1);
+		}
+
+		auto& level = this->levels[depth];
+		auto& s = this->slot(i);
+
+		s.linked = true;
+		s.depth = depth;
+		s.position = level.size();
+
+		level.push_back({ i, parent });
+	}
+
+	inline void Hierarchy::take(Index<Everything> i) {
+		auto& s = this->slots[i];
+		auto& level = this->levels[s.depth];
+
+		auto last = level.back();
+		level[s.position] = last;
+		this->slots[last.entity].position = s.position;
+		level.pop_back();
+
+		s.linked = false;
+	}
+
+	inline void Hierarchy::trim() {
+		while (!this->levels.empty() && this->levels.back().empty()) {
+			this->levels.pop_back();
+		}
+	}
+
+	inline void Hierarchy::link(Index<Everything> i, Index<Everything> parent) {
+		if (parent == 0) {
+			return;
+		}
+
+		auto& s = this->slots[i];
+		auto& p = this->slots[parent];
+
+		s.nextSibling = p.firstChild;
+		s.previousSibling = { 0 };
+
+		if (p.firstChild != 0) {
+			this->slots[p.firstChild].previousSibling = i;
+		}
+
+		p.firstChild = i;
+	}
+
+	inline void Hierarchy::unlink(Index<Everything> i) {
+		auto parent = this->getParent(i);
+		if (parent == 0) {
+			return;
+		}
+
+		auto& s = this->slots[i];
+
+		if (s.previousSibling != 0) {
+			this->slots[s.previousSibling].nextSibling = s.nextSibling;
+		}
+		else {
+			this->slots[parent].firstChild = s.nextSibling;
+		}
+
+		if (s.nextSibling != 0) {
+			this->slots[s.nextSibling].previousSibling = s.previousSibling;
+		}
+
+		s.nextSibling = { 0 };
+		s.previousSibling = { 0 };
+	}
+
+	inline std::vector<std::vector<Index<Everything>>> Hierarchy::collect(Index<Everything> i) {
+		std::vector<std::vector<Index<Everything>>> res{ { i } };
+
+		while (true) {
+			std::vector<Index<Everything>> next{};
+			for (auto j : res.back()) {
+				this->children(j, [&](Index<Everything> child) {
+					next.push_back(child);
+				});
+			}
+
+			if (next.empty()) {
+				return res;
+			}
+
+			res.push_back(std::move(next));
+		}
+	}
+
+	inline bool Hierarchy::contains(Index<Everything> i) const {
+		return i < this->slots.size() && this->slots[i].linked;
+	}
+
+	inline Index<Everything> Hierarchy::getParent(Index<Everything> i) const {
+		if (!this->contains(i)) {
+			return { 0 };
+		}
+
+		auto const& s = this->slots[i];
+		return this->levels[s.depth][s.position].parent;
+	}
+
+	inline size_t Hierarchy::getDepth(Index<Everything> i) const {
+		tassert(this->contains(i));
+		return this->slots[i].depth;
+	}
+
+	inline void Hierarchy::setParent(Index<Everything> i, Index<Everything> parent) {
+		tassert(i != 0);
+
+		if (parent != 0 && !this->contains(parent)) {
+			this->append(parent, { 0 }, 0);
+		}
+
+		for (auto p = parent; p != 0; p = this->getParent(p)) {
+			tassert(p != i);
+		}
+
+		const size_t depth = parent == 0 ? 0 : this->slots[parent].depth + 1;
+
+		if (!this->contains(i)) {
+			this->append(i, parent, depth);
+			this->link(i, parent);
+			return;
+		}
+
+		this->unlink(i);
+
+		auto& s = this->slots[i];
+		if (s.depth == depth) {
+			this->levels[s.depth][s.position].parent = parent;
+			this->link(i, parent);
+			return;
+		}
+
+		// Moved a level at a time, the parents of the nodes below i stay the
+		// same.
+		auto subtree = this->collect(i);
+		for (size_t k = 0; k < subtree.size(); k++) {
+			for (auto j : subtree[k]) {
+				auto const& moved = this->slots[j];
+				auto p = k == 0 ? parent : this->levels[moved.depth][moved.position].parent;
+
+				this->take(j);
+				this->append(j, p, depth + k);
+			}
+		}
+
+		this->link(i, parent);
+		this->trim();
+	}
+
+	inline void Hierarchy::erase(Index<Everything> i) {
+		if (!this->contains(i)) {
+			return;
+		}
+
+		std::vector<Index<Everything>> orphans{};
+		this->children(i, [&](Index<Everything> child) {
+			orphans.push_back(child);
+		});
+
+		for (auto child : orphans) {
+			this->setParent(child, { 0 });
+		}
+
+		this->unlink(i);
+		this->take(i);
+		this->trim();
+	}
 
-		Qualifier getNextQualifier();
-		bool isQualified(Index<Everything> i, Qualifier q) const;
-		Qualifier getQualifier(Index<Everything> i) const;
+	inline void Hierarchy::eraseSubtree(Index<Everything> i, std::vector<Index<Everything>>& out) {
+		if (!this->contains(i)) {
+			return;
+		}
 
-		inline void remove(Index<Everything> i);
+		this->unlink(i);
 
-		void collectRemoved();
+		for (auto const& level : this->collect(i)) {
+			for (auto j : level) {
+				this->take(j);
+				this->slots[j] = {};
+				out.push_back(j);
+			}
+		}
 
-		template<class T>
-		inline void removeComponent(Index<Everything> i);
-		inline void removeComponent(Index<Everything> i, Index<Component> type);
+		this->trim();
+	}
 
-		template<class T>
-		inline void removeAll();
-		inline void removeAll(Index<Component> type);
+	template<class F>
+	inline void Hierarchy::children(Index<Everything> i, F f) const {
+		tassert(this->contains(i));
 
-		template<class T, class... Args>
-		inline T& add(Index<Everything> i, Args&&... args);
+		for (auto child = this->slots[i].firstChild; child != 0; child = this->slots[child].nextSibling) {
+			f(child);
+		}
+	}
 
-		template<class T>
-		inline T& get(Index<Everything> i);
+	inline void RelationPool::sort() {
+		if (this->sorted) {
+			return;
+		}
 
-		template<class T>
-		inline RawData& gets();
+		for (auto* pairs : { &this->forward, &this->backward }) {
+			std::ranges::sort(*pairs);
+			pairs->erase(std::unique(pairs->begin(), pairs->end()), pairs->end());
+		}
 
-		inline RawData& gets(Index<Component> type);
+		this->sorted = true;
+	}
+
+	inline void RelationPool::insert(Index<Everything> source, Index<Everything> target) {
+		this->forward.push_back({ source, target });
+		this->backward.push_back({ target, source });
+		this->sorted = false;
+	}
+
+	inline void RelationPool::erase(Index<Everything> source, Index<Everything> target) {
+		this->sort();
+
+		auto eraseFrom = [](std::vector<Pair>& pairs, Pair const& pair) {
+			auto it = std::ranges::lower_bound(pairs, pair);
+			if (it != pairs.end() && *it == pair) {
+				pairs.erase(it);
+			}
+		};
+
+		eraseFrom(this->forward, { source, target });
+		eraseFrom(this->backward, { target, source });
+	}
+
+	inline bool RelationPool::contains(Index<Everything> source, Index<Everything> target) {
+		this->sort();
+		return std::ranges::binary_search(this->forward, Pair{ source, target });
+	}
+
+	inline std::span<RelationPool::Pair const> RelationPool::bySource(Index<Everything> source) {
+		this->sort();
+		return std::ranges::equal_range(this->forward, source, {}, &Pair::first);
+	}
+
+	inline std::span<RelationPool::Pair const> RelationPool::byTarget(Index<Everything> target) {
+		this->sort();
+		return std::ranges::equal_range(this->backward, target, {}, &Pair::first);
+	}
+
+	inline void RelationPool::purge(std::vector<int32_t> const& validIndices) {
+		for (auto* pairs : { &this->forward, &this->backward }) {
+			std::erase_if(*pairs, [&](Pair const& pair) {
+				return !validIndices[pair.first] || !validIndices[pair.second];
+			});
+		}
+	}
 
 #ifdef LIB_SERIAL
-		bool print(serial::Serializer& serializer, Index<Everything> index, Index<Component> type);
-#endif
+	inline size_t Everything::RelationIds::get(std::string const& name) {
+		std::scoped_lock lock(this->mutex);
 
-		template<class... Ts>
-		inline bool has(Index<Everything> i) const;
+		auto it = this->byName.find(name);
+		if (it != this->byName.end()) {
+			return it->second;
+		}
 
-		inline bool has(Index<Everything> i, Index<Component> type) const;
+		const size_t res = LazyGlobal<Everything::QueryCounter>->increment();
+		this->byName.insert({ name, res });
+		return res;
+	}
+#endif
 
-		Index<RawData> getComponentIndex(Index<Everything> i, Index<Component> type) const;
+	template<class R>
+	inline size_t Everything::relationId() {
+#ifdef LIB_SERIAL
+		static_assert(serial::has_type_name<R>);
+		static const size_t res = LazyGlobal<Everything::RelationIds>->get(std::string(serial::Serializable<R>::typeName));
+#else
+		static const size_t res = LazyGlobal<Everything::QueryCounter>->increment();
+#endif
+		return res;
+	}
 
-		template<class F>
-		inline void run(F f);
+	inline void Everything::setParent(Index<Everything> i, Index<Everything> parent) {
+		tassert(this->isValidIndex(i));
+		tassert(parent == 0 || this->isValidIndex(parent));
 
-		template<class F>
-		inline void match(F f);
+		this->hierarchy.setParent(i, parent);
+	}
 
-		template<class... Ms>
-		Index<Component> selectPivot();
+	inline Index<Everything> Everything::getParent(Index<Everything> i) const {
+		return this->hierarchy.getParent(i);
+	}
 
-		size_t getTypeCount();
+	template<class F>
+	inline void Everything::traverse(F f) {
+		for (auto const& level : this->hierarchy.levels) {
+			for (auto const& node : level) {
+				f(node.entity, node.parent);
+			}
+		}
+	}
 
-		Everything();
-		~Everything() = default;
+	inline void Everything::removeRecursive(Index<Everything> i) {
+		if (!this->hierarchy.contains(i)) {
+			this->remove(i);
+			return;
+		}
 
-		NO_COPY(Everything);
-		DEFAULT_MOVE(Everything);
-	};
+		std::vector<Index<Everything>> subtree{};
+		this->hierarchy.eraseSubtree(i, subtree);
 
-	struct Loop
-	{
-		template<class E, class F>
-		static inline void run(E& e, F f) {
-			using A = te::reverse_t<te::arguments_list_t<F>>;
-			Loop::run<E, F, A>(e, f);
+		for (auto j : subtree) {
+			this->remove(j);
 		}
+	}
 
-		template<class E, class F, te::list L, class... Args>
-		static inline void run(E& e, F f, Args... args) {
-			if constexpr (te::is_empty_v<L>) {
-				f(args...);
-			}
-			else {
-				using head_stripped_ref = std::remove_reference_t<te::head_t<L>>;
-				head_stripped_ref::template run<F, te::tail_t<L>, Args...>(e, f, args...);
-			}
+	template<class R>
+	inline void Everything::relate(Index<Everything> source, Index<Everything> target) {
+		tassert(this->isValidIndex(source));
+		tassert(this->isValidIndex(target));
+
+		this->relations[relationId<R>()].insert(source, target);
+	}
+
+	template<class R>
+	inline void Everything::unrelate(Index<Everything> source, Index<Everything> target) {
+		if (auto it = this->relations.find(relationId<R>()); it != this->relations.end()) {
+			it->second.erase(source, target);
 		}
-	};
+	}
 
-	template<class M, class... Ms>
-	struct Match
-	{
-		WeakObject obj;
+	template<class R>
+	inline bool Everything::isRelated(Index<Everything> source, Index<Everything> target) {
+		auto it = this->relations.find(relationId<R>());
+		return it != this->relations.end()
+			&& this->isValidIndex(source)
+			&& this->isValidIndex(target)
+			&& it->second.contains(source, target);
+	}
 
-		template<class T>
-		inline T& get() {
-			static_assert(te::contains_v<te::list_type<M, Ms...>, T>);
-			return this->obj.template get<T>();
-		};
+	template<class R, class F>
+	inline void Everything::targets(Index<Everything> source, F f) {
+		auto it = this->relations.find(relationId<R>());
+		if (it == this->relations.end() || !this->isValidIndex(source)) {
+			return;
+		}
 
-		template<class T>
-		inline void remove() {
-			static_assert(te::contains_v<te::list_type<M, Ms...>, T>);
-			this->obj.template remove<T>();
-		};
+		for (auto const& [s, target] : it->second.bySource(source)) {
+			if (this->isValidIndex(target)) {
+				f(WeakObject{ target, this });
+			}
+		}
+	}
 
-		template<class F, class L, class... Args>
-		static inline void run(Everything& e, F f, Args... args) {
-			auto pivot = e.selectPivot<M, Ms...>();
+	template<class R, class F>
+	inline void Everything::sources(Index<Everything> target, F f) {
+		auto it = this->relations.find(relationId<R>());
+		if (it == this->relations.end() || !this->isValidIndex(target)) {
+			return;
+		}
 
-			auto& g = e.gets(pivot);
-			const auto end = g.index;
+		for (auto const& [t, source] : it->second.byTarget(target)) {
+			if (this->isValidIndex(source)) {
+				f(WeakObject{ source, this });
+			}
+		}
+	}
 
-			if constexpr (sizeof...(Ms) == 0) {
-				for (Index<RawData> i{ 1 }; i < end; i++) {
-					auto index = g.getIndex(i);
-					Loop::run<Everything, F, L, Match<M, Ms...>, Args...>(e, f, Match<M, Ms...>{ { index, & e } }, args...);
+	template<class F>
+	inline void Everything::scan(SignatureType with, SignatureType without, F f) {
+		if (with.none()) {
+			const auto end = this->signatures.size();
+			for (Index<Everything> i{ 1 }; i < end; i++) {
+				if (this->validIndices[i] && (this->signatures[i] & without).none()) {
+					f(i);
 				}
 			}
-			else {
-				for (Index<RawData> i{ 1 }; i < end; i++) {
-					auto index = g.getIndex(i);
+			return;
+		}
 
-					if (e.has<M, Ms...>(index)) {
-						Loop::run<Everything, F, L, Match<M, Ms...>, Args...>(e, f, Match<M, Ms...>{ { index, & e } }, args...);
-					}
-				}
+		std::array<Index<Component>, SIZE> required{};
+		std::array<Index<Component>, SIZE> excluded{};
+		size_t requiredCount = 0;
+		size_t excludedCount = 0;
+		size_t words = std::numeric_limits<size_t>::max();
+		const auto mask = with | without;
+
+		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+			if (with.test(type)) {
+				required[requiredCount++] = type;
+				words = std::min(words, this->presence[type].size());
 			}
-		};
-	};
+			else if (without.test(type)) {
+				excluded[excludedCount++] = type;
+			}
+		}
 
-	template<class L>
-	struct MatchExpanded;
+		constexpr size_t blockSize = 64;
+		std::array<uint64_t, blockSize> block;
 
-	template<class M, class... Ms>
-	struct MatchExpanded<te::list_type<WeakObject, M, Ms...>>
-	{
-		template<class F>
-		static inline void run(Everything& e, F f) {
-			auto pivot = e.selectPivot<M, Ms...>();
+		// The bitmaps are looked up again for every block, f is allowed to add
+		// and remove components.
+		auto wordsOf = [&](Index<Component> type, size_t start, size_t count) {
+			auto const& bitmap = this->presence[type];
+			return std::min(count, bitmap.size() > start ? bitmap.size() - start : 0);
+		};
 
-			auto& g = e.gets(pivot);
-			const auto end = g.index;
+		for (size_t start = 0; start < words; start += blockSize) {
+			size_t count = std::min(blockSize, words - start);
 
-			if constexpr (sizeof...(Ms) == 0) {
-				for (Index<RawData> i{ 1 }; i < end; i++) {
-					auto index = g.getIndex(i);
-					f(WeakObject{ index, &e }, g.template get<M>(i));
+			// Plain word-wise loops over a block, which compilers vectorize.
+			count = wordsOf(required[0], start, count);
+			std::copy_n(this->presence[required[0]].begin() + start, count, block.begin());
+
+			for (size_t r = 1; r < requiredCount; r++) {
+				count = wordsOf(required[r], start, count);
+				uint64_t const* bitmap = this->presence[required[r]].data() + start;
+				for (size_t w = 0; w < count; w++) {
+					block[w] &= bitmap[w];
 				}
 			}
-			else {
-				for (Index<RawData> i{ 1 }; i < end; i++) {
-					auto index = g.getIndex(i);
 
-					if (e.has<M, Ms...>(index)) {
-						f(WeakObject{ index, &e }, e.template get<M>(index), e.get<Ms>(index)...);
-					}
+			for (size_t x = 0; x < excludedCount; x++) {
+				const size_t end = wordsOf(excluded[x], start, count);
+				uint64_t const* bitmap = this->presence[excluded[x]].data() + start;
+				for (size_t w = 0; w < end; w++) {
+					block[w] &= ~bitmap[w];
 				}
 			}
-		};
-	};
-
-	template<class M, class... Ms>
-	struct MatchExpanded<te::list_type<M, Ms...>>
-	{
-		template<class F>
-		static inline void run(Everything& e, F f) {
-			auto pivot = e.selectPivot<M, Ms...>();
 
-			auto& g = e.gets(pivot);
-			const auto end = g.index;
+			for (size_t w = 0; w < count; w++) {
+				auto word = block[w];
+				while (word != 0) {
+					Index<Everything> i{ (start + w) * 64 + std::countr_zero(word) };
+					word &= word - 1;
 
-			if constexpr (sizeof...(Ms) == 0) {
-				for (Index<RawData> i{ 1 }; i < end; i++) {
-					f(g.template get<M>(i));
+					// The block is a copy, earlier calls can have changed the entity.
+					// The signatures are read in increasing order, which is cheap.
+					if ((this->signatures[i] & mask) == with) {
+						f(i);
+					}
 				}
 			}
-			else {
-				for (Index<RawData> i{ 1 }; i < end; i++) {
-					auto index = g.getIndex(i);
+		}
+	}
 
-					if (e.has<M, Ms...>(index)) {
-						f(e.template get<M>(index), e.get<Ms>(index)...);
+	template<class F>
+	inline void Everything::scan(SignatureType signature, F f) {
+		this->scan(signature, SignatureType{}, f);
+	}
+
+	template<class F>
+	inline Index<Everything> Everything::scanFrom(Index<Everything> from, SignatureType with, SignatureType without, F f) {
+		const auto end = this->signatures.size();
+		const auto mask = with | without;
+
+		if (with.none()) {
+			for (Index<Everything> i = from; i < end; i++) {
+				if (this->validIndices[i] && (this->signatures[i] & without).none()) {
+					if (!f(i)) {
+						return i + 1;
 					}
 				}
 			}
-		};
-	};
+			return Index<Everything>{ end };
+		}
 
-	template<class T>
-	inline void RawData::remove(Index<RawData> i) {
-		tassert(i != 0);
-		tassert(i < this->index);
-		tassert(this->objectSize != 0);
-		tassert(this->objectSize == aligned_sizeof<T>::get());
-		this->removeUntyped(i);
-	}
+		std::array<Index<Component>, SIZE> required{};
+		std::array<Index<Component>, SIZE> excluded{};
+		size_t requiredCount = 0;
+		size_t excludedCount = 0;
 
-	inline std::vector<RawData::DeletedInfo> RawData::packDeletions() {
-		std::vector<RawData::DeletedInfo> res;
+		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
+			if (with.test(type)) {
+				required[requiredCount++] = type;
+			}
+			else if (without.test(type)) {
+				excluded[excludedCount++] = type;
+			}
+		}
 
-		std::sort(this->deletions.begin(), this->deletions.end(), [](auto left, auto right) {return left.i > right.i; });
+		auto wordOf = [&](Index<Component> type, size_t w) -> uint64_t {
+			auto const& bitmap = this->presence[type];
+			return w < bitmap.size() ? bitmap[w] : 0;
+		};
 
-		for (auto i : this->deletions) {
-			size_t targetOffset = i * this->objectSize;
-			size_t sourceOffset = --this->index * this->objectSize;
+		for (size_t w = from / 64; w * 64 < end; w++) {
+			uint64_t word = ~uint64_t(0);
+			for (size_t r = 0; r < requiredCount; r++) {
+				word &= wordOf(required[r], w);
+			}
+			for (size_t x = 0; x < excludedCount; x++) {
+				word &= ~wordOf(excluded[x], w);
+			}
 
-			if (targetOffset == sourceOffset) {
-				this->indices.pop_back();
-				continue;
+			if (w == from / 64) {
+				word &= ~uint64_t(0) << (from % 64);
 			}
-			else {
-				std::memcpy(&this->data[targetOffset], &this->data[sourceOffset], this->objectSize);
-				auto changed = this->indices.back();
-				this->indices.pop_back();
 
-				this->indices[i] = changed;
+			while (word != 0) {
+				Index<Everything> i{ w * 64 + std::countr_zero(word) };
+				word &= word - 1;
 
-				res.push_back({ i, changed });
+				// Earlier calls can have changed the entity.
+				if ((this->signatures[i] & mask) == with && !f(i)) {
+					return i + 1;
+				}
 			}
 		}
 
-		this->deletions.clear();
-
-		return res;
-	}
-
-	inline RawData::~RawData() {
-		tassert(this->deletions.empty());
-		for (Index<RawData> i{ 1 }; i < this->index; i++) {
-			this->structInformation.objectDestructor(this->getUntyped(i));
-		}
+		return Index<Everything>{ end };
 	}
 
-	inline void RawData::removeUntyped(Index<RawData> i) {
-		tassert(i != 0);
-		tassert(i < this->index);
-
-		size_t targetOffset = i * this->objectSize;
-
-		this->structInformation.objectDestructor(&this->data[targetOffset]);
+	inline std::shared_ptr<QueryPlan> Everything::plan(size_t id, QueryFilter const& filter, std::span<Index<Component> const> pooled) {
+		{
+			std::shared_lock lock(this->plansMutex.mutex);
 
-		this->deletions.push_back(i);
-	}
+			auto it = this->plans.find(id);
+			if (it != this->plans.end() && !this->isStale(*it->second, pooled)) {
+				return it->second;
+			}
+		}
 
-	template<class T>
-	inline T& RawData::get(Index<RawData> i) {
-		tassert(i != 0);
-		tassert(i < this->reservedObjects);
-		return *reinterpret_cast<T*>(&this->data[aligned_sizeof<T>::get() * i]);
-	}
+		// Looked up again, another thread can have planned in between.
+		std::unique_lock lock(this->plansMutex.mutex);
+		auto it = this->plans.find(id);
 
-	inline void* RawData::getUntyped(Index<RawData> i) {
-		tassert(i != 0);
-		tassert(i < this->reservedObjects);
-		return static_cast<void*>(&this->data[this->objectSize * i]);
-	}
+		if (it == this->plans.end()) {
+			return this->plans.insert({ id, std::make_shared<QueryPlan>(this->makePlan(filter, pooled)) }).first->second;
+		}
+		else if (this->isStale(*it->second, pooled)) {
+			it->second = std::make_shared<QueryPlan>(this->makePlan(filter, pooled, it->second->observedPassRate()));
+		}
 
-	inline Index<Everything> RawData::getIndex(Index<RawData> i) const {
-		tassert(i != 0);
-		tassert(i < this->index);
-		return this->indices[i];
+		return it->second;
 	}
 
-#ifdef LIB_SERIAL
-	inline bool RawData::print(serial::Serializer& serializer, Index<RawData> i) {
-		return this->structInformation.objectPrinter(serializer, this->getUntyped(i));
+	inline std::optional<double> QueryPlan::observedPassRate() const {
+		// Enough runs to tell it apart from the sample.
+		constexpr size_t minimum = 1024;
+
+		const size_t walked = this->walked.value.load(std::memory_order_relaxed);
+		if (walked < minimum) {
+			return std::nullopt;
+		}
+
+		return double(this->passed.value.load(std::memory_order_relaxed)) / double(walked);
 	}
-#endif
 
-	inline Index<RawData> RawData::cloneUntyped(Index<RawData> i, Index<Everything> j) {
-		tassert(0);
-		tassert(this->index > 1);
-		tassert(i > 0 && i <= this->index);
-		tassert(this->structInformation.clone != nullptr);
-		tassert(this->structInformation.width != 0);
+	inline bool Everything::isStale(QueryPlan const& plan, std::span<Index<Component> const> pooled) const {
+		auto drifted = [](size_t before, size_t now) {
+			// Some slack so small worlds don't plan on every change.
+			return now > 2 * before + 64 || before > 2 * now + 64;
+		};
 
-		if (this->index >= this->reservedObjects) {
-			this->increaseSize();
+		if (plan.groups != this->groups.size() || plan.mergeable != this->canMergeJoin(pooled)) {
+			return true;
 		}
 
-		this->indices.push_back(j);
-		this->structInformation.clone(this->getUntyped(i), this->getUntyped(this->index));
+		if (drifted(plan.entities, this->signatures.size())) {
+			return true;
+		}
 
-		return this->index++;
-	}
+		if (auto observed = plan.observedPassRate()) {
+			if (observed.value() > 2.0 * plan.passRate + 0.05 || plan.passRate > 2.0 * observed.value() + 0.05) {
+				return true;
+			}
+		}
 
-	inline void RawData::increaseSize() {
-		this->reservedObjects *= 2;
-		this->data.resize(this->reservedObjects * this->structInformation.width);
-	}
+		for (auto type : pooled) {
+			if (drifted(plan.counts[type], this->counts[type])) {
+				return true;
+			}
+		}
 
-	template<class T, class... Args>
-	inline std::pair<Index<RawData>, T*> RawData::add(Index<Everything> i, Args&&... args) {
-		this->objectSize = aligned_sizeof<T>::get();
+		return false;
+	}
 
-		if (this->reservedObjects == 0) {
-			this->reservedObjects = 16;
-			this->index.set(1);
-			this->indices.push_back(Index<Everything>{ 0 });
-			this->data.resize(this->reservedObjects * aligned_sizeof<T>::get());
+	inline QueryPlan Everything::makePlan(QueryFilter const& filter, std::span<Index<Component> const> pooled, std::optional<double> observed) const {
+		QueryPlan plan{};
+		plan.filter = filter;
+		plan.entities = this->signatures.size();
+		plan.groups = this->groups.size();
+		plan.mergeable = this->canMergeJoin(pooled);
+		for (auto type : pooled) {
+			plan.counts[type] = this->counts[type];
+		}
 
-			this->structInformation = LazyGlobal<StoredStructInformations>->get<T>();
+		if (auto group = this->selectGroup(pooled)) {
+			plan.strategy = Strategy::group;
+			plan.group.set(group - this->groups.data());
+			return plan;
 		}
-		else if (this->index >= this->reservedObjects) {
-			this->increaseSize();
+
+		auto pivot = this->selectPivot(pooled);
+		if (!pivot.has_value()) {
+			plan.strategy = Strategy::bitmap;
+			return plan;
 		}
 
-		tassert(this->objectSize == aligned_sizeof<T>::get());
-		tassert(this->objectSize != 0);
+		plan.pivot = pivot.value();
 
-		this->indices.push_back(i);
+		// Nothing to sample, the pool of a type that was never added can be
+		// uninitialized. The bitmaps of an empty type end right away.
+		if (this->counts[plan.pivot] == 0 || this->data[plan.pivot].index <= 1) {
+			plan.strategy = Strategy::bitmap;
+			return plan;
+		}
 
-		auto& obj = this->get<T>(this->index);
+		// Sample the pivot pool for the pass rates of the filter and of every
+		// AnyOf term.
+		auto const& pool = this->data[plan.pivot];
+		const size_t slots = pool.index - 1;
+		const size_t samples = std::min<size_t>(128, slots);
 
-		new (&obj) T{ std::forward<Args>(args)... };
+		std::vector<size_t> anyPasses(filter.anyOf.size(), 0);
+		size_t passes = 0;
+		size_t sampled = 0;
 
-		return { Index<RawData>{ this->index++ }, &obj };
-	}
+		for (size_t k = 0; k < samples; k++) {
+			auto index = pool.getIndex(Index<RawData>{ 1 + k * slots / samples });
+			if (index == 0) {
+				continue;
+			}
 
-	inline void Everything::remove(Index<Everything> i) {
-		if (i == 0 || !this->isValidIndex(i)) {
-			return;
-		}
+			auto const& signature = this->signatures[index];
+			sampled++;
+			passes += filter.test(signature);
 
-		for (Index<Component> type{ 0 }; type < this->getTypeCount(); type++) {
-			if (this->has(i, type)) {
-				this->data[type].removeUntyped(this->dataIndices[type][i]);
+			for (size_t a = 0; a < filter.anyOf.size(); a++) {
+				anyPasses[a] += (signature & filter.anyOf[a]).any();
 			}
 		}
 
-		this->signatures[i].reset();
+		if (sampled != 0) {
+			plan.passRate = double(passes) / double(sampled);
+		}
 
-		this->qualifiers[i] = this->getNextQualifier();
+		if (observed.has_value()) {
+			plan.passRate = observed.value();
+		}
 
-		tassert(std::ranges::find(this->removed, i) == this->removed.end());
-		this->removed.push_back(i);
+		plan.sampled = true;
 
-		tassert(this->validIndices[i]);
-		this->validIndices[i] = false;
-	}
+		std::vector<size_t> order(filter.anyOf.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::ranges::stable_sort(order, [&](size_t left, size_t right) {
+			return anyPasses[left] < anyPasses[right];
+		});
+		for (size_t a = 0; a < order.size(); a++) {
+			plan.filter.anyOf[a] = filter.anyOf[order[a]];
+		}
 
-	inline void Everything::collectRemoved() {
-		for (size_t type = 0; type < this->getTypeCount(); type++) {
-			for (auto const& d : this->data[type].packDeletions()) {
-				this->dataIndices[type][d.changed] = d.i;
+		// Rough costs in sequential reads, a probe of a random signature counts
+		// as a cache miss. Batches with prefetching overlap the misses, which
+		// only pays off once the tables no longer fit in cache.
+		constexpr double probeCost = 4.0;
+		constexpr double prefetchedProbeCost = 1.5;
+		constexpr size_t prefetchEntities = 1 << 15;
+
+		const double pivotCount = double(this->counts[plan.pivot]);
+		const double matches = pivotCount * plan.passRate;
+
+		const double pivotCost = pivotCount * probeCost + matches;
+		const double prefetchCost = pivotCount * prefetchedProbeCost * double(1 + pooled.size()) / 2.0 + matches;
+		const double bitmapCost = double(this->signatures.size()) / 64.0 * double(filter.mask.count()) + matches;
+
+		double mergeCost = std::numeric_limits<double>::max();
+		if (plan.mergeable) {
+			mergeCost = matches;
+			for (auto type : pooled) {
+				const double count = double(this->counts[type]);
+				mergeCost += std::min(count, pivotCount * (1.0 + std::log2(count / std::max(pivotCount, 1.0) + 1.0)));
 			}
 		}
 
-		for (auto i : this->removed) {
-			tassert(this->signatures[i].none());
-			tassert(std::ranges::find(this->freeIndirections, i) == this->freeIndirections.end());
-			this->freeIndirections.push_back(i);
+		plan.strategy = Strategy::pivot;
+		double best = pivotCost;
+
+		if (this->signatures.size() >= prefetchEntities && prefetchCost < best) {
+			plan.strategy = Strategy::prefetch;
+			best = prefetchCost;
 		}
 
-		this->removed.clear();
-	}
+		if (filter.mask.count() > 1 && bitmapCost < best) {
+			plan.strategy = Strategy::bitmap;
+			best = bitmapCost;
+		}
 
-	inline void Everything::removeComponent(Index<Everything> i, Index<Component> type) {
-		tassert(this->signatures[i].test(type));
-		this->data[type].removeUntyped(this->dataIndices[type][i]);
-		this->signatures[i].reset(type);
+		if (mergeCost < best) {
+			plan.strategy = Strategy::merge;
+		}
+
+		return plan;
 	}
 
-	inline void Everything::removeAll(Index<Component> type) {
-		for (size_t i = 1; i < this->data[type].indices.size(); i++) {
-			auto index = this->data[type].indices[i];
-			if (this->has(index, type)) {
-				this->removeComponent(index, type);
+	template<class F>
+	inline void Everything::mergeJoin(std::span<Index<Component> const> types, F f) {
+		tassert(this->canMergeJoin(types));
+
+		const size_t count = types.size();
+		std::array<RawData const*, SIZE> pools{};
+		std::array<Index<RawData>, SIZE> positions{};
+
+		for (size_t k = 0; k < count; k++) {
+			pools[k] = &this->data[types[k]];
+			positions[k].set(1);
+
+			if (pools[k]->index <= 1) {
+				return;
 			}
 		}
-	}
 
-	inline RawData& Everything::gets(Index<Component> type) {
-		return this->data[type];
-	}
+		const std::span<Index<RawData> const> slots(positions.data(), count);
 
-#ifdef LIB_SERIAL
-	inline bool Everything::print(serial::Serializer& serializer, Index<Everything> index, Index<Component> type) {
-		return this->data[type].print(serializer, this->dataIndices[type][index]);
-	}
-#endif
+		auto target = pools[0]->indices[1];
+		size_t agreed = 0;
+		size_t k = 0;
 
-	inline bool Everything::has(Index<Everything> i, Index<Component> type) const {
-		return this->signatures[i].test(type);
-	}
+		while (true) {
+			auto& position = positions[k];
+			position = pools[k]->gallop(position, target);
 
-	inline Index<RawData> Everything::getComponentIndex(Index<Everything> i, Index<Component> type) const {
-		tassert(this->has(i, type));
-		return this->dataIndices[type][i];
-	}
+			if (position >= pools[k]->index) {
+				return;
+			}
 
-	inline size_t Everything::getTypeCount() {
-		return LazyGlobal<ComponentCounter>->size();
-	}
+			auto candidate = pools[k]->indices[position];
 
-	inline Everything::Everything() {
-		for (Index<Component> type{ 0 }; type < SIZE; type++) {
-			this->dataIndices[type].push_back(Index<RawData>{ 0 });
+			// Removed by f during the join.
+			if (candidate == 0) {
+				position++;
+				continue;
+			}
+
+			if (candidate == target) {
+				agreed++;
+			}
+			else {
+				target = candidate;
+				agreed = 1;
+			}
+
+			if (agreed == count) {
+				f(target, slots);
+
+				for (size_t j = 0; j < count; j++) {
+					if (++positions[j] >= pools[j]->index) {
+						return;
+					}
+				}
+
+				target = pools[0]->indices[positions[0]];
+				agreed = 0;
+				k = 0;
+			}
+			else {
+				k = (k + 1) % count;
+			}
 		}
 	}
 
-	template<class... Ms>
-	inline UniqueObject Everything::clone(WeakObject const& obj) {
-		std::vector<Index<Component>> components;
+	inline bool Everything::canMergeJoin(std::span<Index<Component> const> types) const {
+		if (types.size() < 2) {
+			return false;
+		}
 
-		for (auto component : { Everything::component_index_v<Ms>... }) {
-			components.push_back(component);
+		for (auto type : types) {
+			auto const& pool = this->data[type];
+			if (this->getStorage(type) != Storage::pool || !pool.sorted || !pool.deletions.empty()) {
+				return false;
+			}
 		}
 
-		return this->clone(components, obj);
+		return true;
 	}
 
-	template<class T>
-	inline void Everything::removeComponent(Index<Everything> i) {
-		this->removeComponent(i, component_index_v<T>);
-	}
+	template<class T, class F>
+	inline void Everything::groupBy(F f) {
+		static_assert(storage_policy_v<T> == Storage::shared);
 
-	template<class T>
-	inline void Everything::removeAll() {
-		this->removeAll(component_index_v<T>);
-	}
+		auto& g = this->gets<T>();
+		const auto end = g.index;
+		if (end <= 1) {
+			return;
+		}
 
-	template<class T, class... Args>
-	inline T& Everything::add(Index<Everything> i, Args&&... args) {
-		tassert(!this->has<T>(i));
-		auto [index, ptr] = this->data[component_index_v<T>].template add<T>(i, std::forward<Args>(args)...);
-		this->dataIndices[component_index_v<T>][i] = index;
-		this->signatures[i].set(component_index_v<T>);
-		return *ptr;
-	}
+		// Counting sort of the objects by the slot of their shared value.
+		std::vector<size_t> offsets(end + 1, 0);
 
-	template<class T>
-	inline T& Everything::get(Index<Everything> i) {
-		return this->data[component_index_v<T>].template get<T>(this->dataIndices[component_index_v<T>][i]);
-	}
+		SignatureType signature{};
+		signature.set(component_index_v<T>);
 
-	template<class T>
-	inline RawData& Everything::gets() {
-		return this->gets(component_index_v<T>);
-	}
+		this->scan(signature, [&](Index<Everything> i) {
+			offsets[this->dataIndices[component_index_v<T>][i] + 1]++;
+		});
 
-	template<class... Ts>
-	inline bool Everything::has(Index<Everything> i) const {
-		static_assert(sizeof...(Ts) != 0);
-		if constexpr (sizeof...(Ts) == 1) {
-			return this->signatures[i].test(Everything::component_index_v<typename te::head_t<te::list_type<Ts...>>>);
-		}
-		else {
-			auto const sig = group_signature_v<Ts...>;
-			return (this->signatures[i] & sig) == sig;
+		for (size_t i = 1; i < offsets.size(); i++) {
+			offsets[i] += offsets[i - 1];
 		}
-	}
 
-	template<class F>
-	inline void Everything::run(F f) {
-		Loop::run(*this, f);
-	}
+		std::vector<WeakObject> objects(offsets.back());
+		auto positions = offsets;
 
-	template<class F>
-	inline void Everything::match(F f) {
-		using arguments_list = te::map_t<
-			te::type_function_t<std::remove_cvref_t>,
-			te::arguments_list_t<F>
-		>;
+		this->scan(signature, [&](Index<Everything> i) {
+			objects[positions[this->dataIndices[component_index_v<T>][i]]++] = WeakObject{ i, this };
+		});
 
-		MatchExpanded<arguments_list>::run(*this, f);
+		for (Index<RawData> i{ 1 }; i < end; i++) {
+			if (g.isAlive(i)) {
+				f(std::as_const(g.template get<T>(i)), std::span<WeakObject const>(objects.begin() + offsets[i], objects.begin() + offsets[i + 1]));
+			}
+		}
 	}
 
 	template<class... Ms>
-	inline Index<Component> Everything::selectPivot() {
-		Index<Component> pivot{ 0 };
+	inline std::optional<Index<Component>> Everything::selectPivot() {
+		std::array<Index<Component>, sizeof...(Ms)> pooled{};
+		size_t count = 0;
+		for (auto [s, storage] : { std::make_pair(Everything::component_index_v<Ms>, storage_policy_v<Ms>)... }) {
+			if (storage == Storage::pool) {
+				pooled[count++] = s;
+			}
+		}
+		return this->selectPivot(std::span(pooled.data(), count));
+	}
+
+	inline std::optional<Index<Component>> Everything::selectPivot(std::span<Index<Component> const> pooled) const {
+		// Tags have no pool, dense pools are as large as the entity range and
+		// shared pools only hold the distinct values, only pooled types are
+		// candidates.
+		std::optional<Index<Component>> pivot{};
 		size_t smallest = std::numeric_limits<size_t>::max();
-		for (auto s : { Everything::component_index_v<Ms>... }) {
-			size_t typeSize = this->data[s].index;
+		for (auto s : pooled) {
+			// Live objects, the pool can still hold removed objects until the next
+			// collectRemoved.
+			size_t typeSize = this->counts[s];
 
 			if (typeSize < smallest) {
 				smallest = typeSize;
@@ -831,7 +4821,9 @@ namespace mem
 	}
 
 	template<class T>
-	inline te::optional_ref<T> WeakObject::getMaybe() {
+	inline te::optional_ref<std::remove_reference_t<component_reference_t<T>>> WeakObject::getMaybe() {
+		static_assert(storage_policy_v<T> != Storage::split, "split components are read by value");
+
 		if (this->has<T>()) {
 			return this->get<T>();
 		}
@@ -841,17 +4833,17 @@ namespace mem
 	}
 
 	template<class T>
-	inline T& WeakObject::get() {
+	inline component_reference_t<T> WeakObject::get() {
 		return this->proxy->get<T>(this->index);
 	}
 
 	template<class T, class... Args>
-	inline T& WeakObject::add(Args&&... args) {
+	inline component_reference_t<T> WeakObject::add(Args&&... args) {
 		return this->proxy->add<T>(this->index, std::forward<Args>(args)...);
 	}
 
 	template<class T, class... Args>
-	inline T& WeakObject::addOrGet(Args&&... args) {
+	inline component_reference_t<T> WeakObject::addOrGet(Args&&... args) {
 		if (this->has<T>()) {
 			return this->get<T>();
 		}
@@ -861,8 +4853,20 @@ namespace mem
 	}
 
 	template<class T, class ...Args>
-	inline T& WeakObject::addOrReplace(Args&&... args) {
-		if (auto component = this->getMaybe<T>()) {
+	inline component_reference_t<T> WeakObject::addOrReplace(Args&&... args) {
+		if constexpr (storage_policy_v<T> == Storage::shared) {
+			if (this->has<T>()) {
+				return this->proxy->template replaceShared<T>(this->index, std::forward<Args>(args)...);
+			}
+			return this->add<T>(std::forward<Args>(args)...);
+		}
+		else if constexpr (storage_policy_v<T> == Storage::split) {
+			if (this->has<T>()) {
+				this->remove<T>();
+			}
+			return this->add<T>(std::forward<Args>(args)...);
+		}
+		else if (auto component = this->getMaybe<T>()) {
 			component.value() = T(std::forward<T>(args)...);
 			return component.value();
 		}
@@ -872,7 +4876,7 @@ namespace mem
 	}
 
 	template<class T, class... Args>
-	inline T& WeakObject::tryAdd(Args&&... args) {
+	inline component_reference_t<T> WeakObject::tryAdd(Args&&... args) {
 		if (this->has<T>()) {
 			return this->get<T>();
 		}
@@ -908,8 +4912,111 @@ struct serial::Serializable<mem::Everything>
 {
 	inline static const auto typeName = "Everything";
 
-	ALL_DEF(mem::Everything) {
-		return serializer.runAll<Selector>(
+	READ_DEF(mem::Everything) {
+		if (!serializer.readAll(
+			obj.data,
+			obj.freeIndirections,
+			obj.qualifiers,
+			obj.qualifier,
+			obj.signatures,
+			obj.dataIndices,
+			obj.removed,
+			obj.validIndices,
+			obj.groups,
+			obj.groupOwners,
+			obj.presence,
+			obj.counts
+		)) return false;
+
+		// Parents come before their children.
+		std::vector<Index<mem::Everything>> entities{};
+		std::vector<Index<mem::Everything>> parents{};
+		if (!serializer.readAll(entities, parents)) return false;
+
+		obj.hierarchy = {};
+		for (size_t k = 0; k < entities.size(); k++) {
+			obj.hierarchy.setParent(entities[k], parents[k]);
+		}
+
+		// Relation pools by the type name of the relation, pairs as source and
+		// target after each other.
+		std::vector<std::string> relationNames{};
+		if (!serializer.readAll(relationNames)) return false;
+
+		obj.relations.clear();
+		for (auto const& name : relationNames) {
+			std::vector<Index<mem::Everything>> pairs{};
+			if (!serializer.readAll(pairs)) return false;
+
+			auto& pool = obj.relations[LazyGlobal<mem::Everything::RelationIds>->get(name)];
+			for (size_t k = 0; k + 1 < pairs.size(); k += 2) {
+				pool.insert(pairs[k], pairs[k + 1]);
+			}
+		}
+
+		// Field indexes are not saved, the declared ones are filled from the
+		// loaded components.
+		obj.rebuildFieldIndexes();
+
+		return true;
+	}
+
+	WRITE_DEF(mem::Everything) {
+		if (!serializer.writeAll(
+			obj.data,
+			obj.freeIndirections,
+			obj.qualifiers,
+			obj.qualifier,
+			obj.signatures,
+			obj.dataIndices,
+			obj.removed,
+			obj.validIndices,
+			obj.groups,
+			obj.groupOwners,
+			obj.presence,
+			obj.counts
+		)) return false;
+
+		std::vector<Index<mem::Everything>> entities{};
+		std::vector<Index<mem::Everything>> parents{};
+		obj.traverse([&](Index<mem::Everything> i, Index<mem::Everything> parent) {
+			entities.push_back(i);
+			parents.push_back(parent);
+		});
+
+		if (!serializer.writeAll(entities, parents)) return false;
+
+		std::vector<std::string> relationNames{};
+		std::vector<std::vector<Index<mem::Everything>>> relationPairs{};
+		auto& relationIds = LazyGlobal<mem::Everything::RelationIds>.get();
+		std::scoped_lock lock(relationIds.mutex);
+
+		for (auto const& [name, id] : relationIds.byName) {
+			auto it = obj.relations.find(id);
+			if (it == obj.relations.end()) {
+				continue;
+			}
+
+			auto& pairs = relationPairs.emplace_back();
+			for (auto const& [source, target] : it->second.forward) {
+				pairs.push_back(source);
+				pairs.push_back(target);
+			}
+
+			relationNames.push_back(name);
+		}
+
+		if (!serializer.writeAll(relationNames)) return false;
+
+		for (auto const& pairs : relationPairs) {
+			if (!serializer.writeAll(pairs)) return false;
+		}
+
+		return true;
+	}
+
+	PRINT_DEF(mem::Everything) {
+		return serializer.runAll<Print>(
 			ALL(data),
 			ALL(freeIndirections),
 			ALL(qualifiers),
@@ -917,7 +5024,25 @@ struct serial::Serializable<mem::Everything>
 			ALL(signatures),
 			ALL(dataIndices),
 			ALL(removed),
-			ALL(validIndices)
+			ALL(validIndices),
+			ALL(groups),
+			ALL(groupOwners),
+			ALL(presence),
+			ALL(counts)
+			);
+	}
+};
+
+template<>
+struct serial::Serializable<mem::OwningGroup>
+{
+	inline static const auto typeName = "OwningGroup";
+
+	ALL_DEF(mem::OwningGroup) {
+		return serializer.runAll<Selector>(
+			ALL(signature),
+			ALL(pivot),
+			ALL(size)
 			);
 	}
 };
@@ -936,8 +5061,11 @@ struct serial::Serializable<mem::WeakObject>
 
 			for (Index<Component> i{ 0 }; i < end; i++) {
 				if (obj.has(i)) {
-					serializer.printIndentedString(obj.proxy->data[i].structInformation.name + " ");
-					obj.proxy->print(serializer, obj.index, i);
+					auto const& info = LazyGlobal<mem::StoredStructInformations>->indexed[i];
+					serializer.printIndentedString(info.name + " ");
+					if (info.storage != mem::Storage::tag) {
+						obj.proxy->print(serializer, obj.index, i);
+					}
 				}
 			}
 
@@ -1067,13 +5195,46 @@ struct serial::Serializable<mem::RawData>
 			obj.index,
 			obj.objectSize,
 			obj.indices,
-			obj.deletions
+			obj.deletions,
+			obj.references,
+			obj.freeSlots,
+			obj.sorted
 		)) return false;
 
+		if (obj.structInformation.storage == mem::Storage::split) {
+			for (auto width : obj.structInformation.columnWidths) {
+				obj.columns.push_back({ width, std::vector<std::byte>(width * obj.reservedObjects) });
+			}
+
+			// Read through a whole component put together from the fields.
+			std::vector<std::byte> scratch(obj.structInformation.width);
+			for (Index<mem::RawData> i{ 1 }; i < obj.index; i++) {
+				if (!obj.isAlive(i)) continue;
+				obj.structInformation.load(obj, i, scratch.data());
+				const bool ok = obj.readObject(serializer, scratch.data());
+				obj.structInformation.store(obj, i, scratch.data());
+				obj.structInformation.objectDestructor(scratch.data());
+				if (!ok) return false;
+			}
+
+			return true;
+		}
+
 		obj.data.resize(obj.structInformation.width * obj.reservedObjects);
 
 		for (Index<mem::RawData> i{ 1 }; i < obj.index; i++) {
-			if (!obj.structInformation.objectReader(serializer, obj.getUntyped(i))) return false;
+			if (!obj.isAlive(i)) continue;
+			if (!obj.readObject(serializer, obj.getUntyped(i))) return false;
+
+			if (obj.structInformation.storage == mem::Storage::shared) {
+				obj.sharedLookup.insert({ obj.structInformation.hash(obj.getUntyped(i)), i });
+			}
+		}
+
+		// Only the current values are saved, they are the previous ones as well.
+		if (obj.structInformation.buffered) {
+			obj.front = obj.data;
+			obj.dirty.assign(obj.reservedObjects, std::byte{ 0 });
 		}
 
 		return true;
@@ -1086,11 +5247,28 @@ struct serial::Serializable<mem::RawData>
 			obj.index,
 			obj.objectSize,
 			obj.indices,
-			obj.deletions
+			obj.deletions,
+			obj.references,
+			obj.freeSlots,
+			obj.sorted
 		)) return false;
 
+		if (obj.structInformation.storage == mem::Storage::split) {
+			std::vector<std::byte> scratch(obj.structInformation.width);
+			for (Index<mem::RawData> i{ 1 }; i < obj.index; i++) {
+				if (!obj.isAlive(i)) continue;
+				obj.structInformation.load(obj, i, scratch.data());
+				const bool ok = obj.writeObject(serializer, scratch.data());
+				obj.structInformation.objectDestructor(scratch.data());
+				if (!ok) return false;
+			}
+
+			return true;
+		}
+
 		for (Index<mem::RawData> i{ 1 }; i < obj.index; i++) {
-			if (!obj.structInformation.objectWriter(serializer, obj.getUntyped(i))) return false;
+			if (!obj.isAlive(i)) continue;
+			if (!obj.writeObject(serializer, obj.getUntyped(i))) return false;
 		}
 
 		return true;
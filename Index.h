@@ -6,6 +6,8 @@
 #include <cstdint>
 #include <concepts>
 #include <memory>
+#include <vector>
+#include <span>
 
 #ifdef LIB_SERIAL
 #include <serial/Serializer.h>
@@ -13,7 +15,18 @@
 
 using default_index_type = size_t;
 
-template<class T, std::integral index_type_ = default_index_type>
+// Specialize to change the width of Index<T> for a particular T, for example
+// to store 32 bit indices in tables that will never exceed 2^32 entries.
+template<class T>
+struct default_index_type_of
+{
+	using type = default_index_type;
+};
+
+template<class T>
+using default_index_type_of_t = typename default_index_type_of<T>::type;
+
+template<class T, std::integral index_type_ = default_index_type_of_t<T>>
 struct Index
 {
 	using index_type = index_type_;
@@ -77,8 +90,46 @@ struct Index
 	Index& operator=(Index&&) = default;
 };
 
-template<class T, class S, class index_type = default_index_type>
-struct IndexConverter;
+// Dense table from the indices of T to the indices of S, 0 maps to 0. For
+// example where the objects of a merged world ended up.
+template<class T, class S, class index_type = default_index_type_of_t<T>>
+struct IndexConverter
+{
+	std::vector<Index<S>> table{ Index<S>{ 0 } };
+
+	void resize(size_t size) {
+		this->table.resize(size, Index<S>{ 0 });
+	}
+
+	size_t size() const {
+		return this->table.size();
+	}
+
+	void set(Index<T, index_type> from, Index<S> to) {
+		if (from >= this->table.size()) {
+			this->resize(from + 1);
+		}
+
+		this->table[from] = to;
+	}
+
+	// 0 for indices without an entry.
+	Index<S> operator()(Index<T, index_type> i) const {
+		return i < this->table.size() ? this->table[i] : Index<S>{ 0 };
+	}
+
+	void convert(std::span<Index<T, index_type> const> in, std::span<Index<S>> out) const {
+		for (size_t k = 0; k < in.size(); k++) {
+			out[k] = (*this)(in[k]);
+		}
+	}
+
+	void convert(std::span<Index<T, index_type>> indices) const requires std::same_as<Index<T, index_type>, Index<S>> {
+		for (auto& i : indices) {
+			i = (*this)(i);
+		}
+	}
+};
 
 template<class T>
 struct std::hash<Index<T>>
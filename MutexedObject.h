@@ -5,20 +5,7 @@
 
 #include <mutex>
 
-#define DEFAULT_COPY(T) \
-	T(const T&) = default; \
-	T& operator=(const T&) = default;
-#define NO_COPY(T) \
-	T(const T&) = delete; \
-	T& operator=(const T&) = delete;
-#define DEFAULT_MOVE(T) \
-	T(T&&) = default; \
-	T& operator=(T&&) = default;
-#define NO_MOVE(T) \
-	T(T&&) = delete; \
-	T& operator=(T&&) = delete;
-#define DEFAULT_COPY_MOVE(T) DEFAULT_COPY(T) DEFAULT_MOVE(T)
-#define NO_COPY_MOVE(T) NO_COPY(T) NO_MOVE(T)
+#include "Macros.h"
 
 namespace mem
 {
@@ -0,0 +1,311 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <atomic>
+
+#include <tepp/tepp.h>
+
+#include "Everything.h"
+#include "MutexedObject.h"
+#include "ThreadPool.h"
+
+namespace mem
+{
+	// Components a system reads and writes.
+	struct SystemAccess
+	{
+		SignatureType reads{};
+		SignatureType writes{};
+
+		// Has to run alone.
+		bool exclusive = false;
+
+		inline bool conflicts(SystemAccess const& other) const {
+			return this->exclusive || other.exclusive
+				|| (this->writes & (other.reads | other.writes)).any()
+				|| (other.writes & this->reads).any();
+		}
+	};
+
+	// Access through one term of a match lambda, write is whether the argument
+	// is a mutable reference.
+	template<class T>
+	struct system_term
+	{
+		static inline void fill(SystemAccess& access, bool write) {
+			// Reads of double buffered components see the front buffer, which
+			// only changes in swapBuffers.
+			if (!write && double_buffered_v<T>) {
+				return;
+			}
+
+			// Shared and split components can only be changed by replacing them,
+			// which is a structural change.
+			if (write && storage_policy_v<T> != Storage::shared && storage_policy_v<T> != Storage::split) {
+				access.writes.set(Everything::component_index_v<T>);
+			}
+			else {
+				access.reads.set(Everything::component_index_v<T>);
+			}
+		}
+	};
+
+	// Anything done through the object has to be deferred.
+	template<>
+	struct system_term<WeakObject>
+	{
+		static inline void fill(SystemAccess&, bool) {
+		}
+	};
+
+	// Only looks at signatures, which don't change until the next sync point.
+	template<class T>
+	struct system_term<Without<T>>
+	{
+		static inline void fill(SystemAccess&, bool) {
+		}
+	};
+
+	template<class T>
+	struct system_term<Previous<T>>
+	{
+		static inline void fill(SystemAccess&, bool) {
+		}
+	};
+
+	template<class... Ts>
+	struct system_term<AnyOf<Ts...>>
+	{
+		static inline void fill(SystemAccess&, bool) {
+		}
+	};
+
+	template<class T>
+	struct system_term<Optional<T>>
+	{
+		static inline void fill(SystemAccess& access, bool) {
+			system_term<T>::fill(access, true);
+		}
+	};
+
+	template<class F>
+	inline SystemAccess inferAccess() {
+		SystemAccess res{};
+
+		[&]<class... Args>(te::list_type<Args...>) {
+			(system_term<std::remove_cvref_t<Args>>::fill(
+				res,
+				std::is_lvalue_reference_v<Args> && !std::is_const_v<std::remove_reference_t<Args>>
+			), ...);
+		}(te::arguments_list_t<F>{});
+
+		return res;
+	}
+
+	// Runs a list of match systems every tick, in parallel where their access
+	// does not conflict and in the order they were added where it does.
+	// Structural changes (adding or removing components or objects) are not
+	// allowed inside systems, they are deferred to the next sync point.
+	struct Scheduler
+	{
+		struct System
+		{
+			std::string name{};
+			SystemAccess access{};
+			std::function<void(Everything&)> run{};
+			std::function<void(Everything&)> prepare{};
+		};
+
+	private:
+		struct Node
+		{
+			std::vector<size_t> successors{};
+			size_t predecessors = 0;
+		};
+
+		// Systems between two sync points.
+		std::vector<std::vector<System>> stages{ 1 };
+		std::vector<std::vector<Node>> graphs{};
+		bool dirty = true;
+
+		MutexedObject<std::vector<std::function<void(Everything&)>>> commands{};
+
+		inline void build();
+		inline void runStage(Everything& e, ThreadPool& pool, size_t stage);
+		inline void flush(Everything& e);
+
+	public:
+		// Adds a system running e.match(f), what it reads and writes is inferred
+		// from the const-ness of the arguments of f.
+		template<class F>
+		inline void add(std::string name, F f);
+
+		// Adds a system that gets the whole world, it runs alone between two sync
+		// points and can change the structure directly.
+		inline void addExclusive(std::string name, std::function<void(Everything&)> f);
+
+		// Systems added after a sync point run after the deferred commands of the
+		// systems before it are applied and removed objects are collected.
+		inline void sync();
+
+		// Thread safe, f runs at the next sync point. Commands from systems that
+		// run in parallel are applied in no particular order.
+		inline void defer(std::function<void(Everything&)> f);
+
+		inline std::vector<std::vector<System>> const& getStages() const;
+
+		// Runs every system once.
+		inline void run(Everything& e, ThreadPool& pool);
+
+		// Runs every system once on this thread, in the order they were added.
+		inline void runSequential(Everything& e);
+
+		Scheduler() = default;
+		~Scheduler() = default;
+
+		NO_COPY_MOVE(Scheduler);
+	};
+
+	template<class F>
+	inline void Scheduler::add(std::string name, F f) {
+		this->stages.back().push_back({
+			std::move(name),
+			inferAccess<F>(),
+			[f](Everything& e) {
+				e.match(f);
+			},
+			[](Everything& e) {
+				e.preparePlan<F>();
+			}
+		});
+
+		this->dirty = true;
+	}
+
+	inline void Scheduler::addExclusive(std::string name, std::function<void(Everything&)> f) {
+		this->sync();
+		this->stages.back().push_back({
+			std::move(name),
+			SystemAccess{ .exclusive = true },
+			std::move(f),
+			[](Everything&) {}
+		});
+		this->sync();
+	}
+
+	inline void Scheduler::sync() {
+		if (!this->stages.back().empty()) {
+			this->stages.emplace_back();
+			this->dirty = true;
+		}
+	}
+
+	inline void Scheduler::defer(std::function<void(Everything&)> f) {
+		this->commands.do_([&](auto& commands) {
+			commands.push_back(std::move(f));
+		});
+	}
+
+	inline std::vector<std::vector<Scheduler::System>> const& Scheduler::getStages() const {
+		return this->stages;
+	}
+
+	inline void Scheduler::build() {
+		this->graphs.clear();
+
+		for (auto const& systems : this->stages) {
+			auto& graph = this->graphs.emplace_back(systems.size());
+
+			// A system waits for every earlier system it conflicts with.
+			for (size_t j = 0; j < systems.size(); j++) {
+				for (size_t i = 0; i < j; i++) {
+					if (systems[i].access.conflicts(systems[j].access)) {
+						graph[i].successors.push_back(j);
+						graph[j].predecessors++;
+					}
+				}
+			}
+		}
+
+		this->dirty = false;
+	}
+
+	inline void Scheduler::runStage(Everything& e, ThreadPool& pool, size_t stage) {
+		auto& systems = this->stages[stage];
+		auto const& graph = this->graphs[stage];
+
+		if (systems.empty()) {
+			return;
+		}
+
+		// Plans are made up front, so the systems mostly only read the plan
+		// cache. Queries run inside f still plan under the lock of the cache.
+		for (auto& system : systems) {
+			system.prepare(e);
+		}
+
+		std::vector<std::atomic<size_t>> remaining(systems.size());
+		for (size_t k = 0; k < systems.size(); k++) {
+			remaining[k].store(graph[k].predecessors);
+		}
+
+		std::function<void(size_t)> launch = [&](size_t k) {
+			pool.submit([&, k] {
+				systems[k].run(e);
+
+				for (auto next : graph[k].successors) {
+					if (--remaining[next] == 0) {
+						launch(next);
+					}
+				}
+			});
+		};
+
+		for (size_t k = 0; k < systems.size(); k++) {
+			if (graph[k].predecessors == 0) {
+				launch(k);
+			}
+		}
+
+		pool.wait();
+	}
+
+	inline void Scheduler::flush(Everything& e) {
+		std::vector<std::function<void(Everything&)>> pending;
+		this->commands.do_([&](auto& commands) {
+			std::swap(pending, commands);
+		});
+
+		for (auto& command : pending) {
+			command(e);
+		}
+
+		e.collectRemoved();
+	}
+
+	inline void Scheduler::run(Everything& e, ThreadPool& pool) {
+		if (this->dirty) {
+			this->build();
+		}
+
+		for (size_t stage = 0; stage < this->stages.size(); stage++) {
+			this->runStage(e, pool, stage);
+			this->flush(e);
+		}
+	}
+
+	inline void Scheduler::runSequential(Everything& e) {
+		for (auto& systems : this->stages) {
+			for (auto& system : systems) {
+				system.run(e);
+			}
+
+			this->flush(e);
+		}
+	}
+}
@@ -0,0 +1,292 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#pragma once
+
+#include <vector>
+#include <tuple>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+#include <tepp/tepp.h>
+
+#include "Index.h"
+
+namespace mem
+{
+	// A world whose full set of component types is known at compile time.
+	// Component ids, signatures and the layout of the pools are constants, so
+	// get and has compile to a fixed pool and mask without the registries of
+	// Everything.
+	template<class... Cs>
+	struct StaticEverything
+	{
+		static_assert(sizeof...(Cs) <= 64);
+
+		using SignatureType = uint64_t;
+
+		static constexpr size_t componentCount = sizeof...(Cs);
+
+		template<class T>
+		static constexpr bool is_component_v = te::contains_v<te::list_type<Cs...>, T>;
+
+		template<class T>
+		static constexpr size_t component_index_v = [] {
+			static_assert(is_component_v<T>);
+			static_assert((size_t(std::is_same_v<T, Cs>) + ...) == 1);
+
+			constexpr std::array<bool, componentCount> same{ std::is_same_v<T, Cs>... };
+			return static_cast<size_t>(std::ranges::find(same, true) - same.begin());
+		}();
+
+		template<class... Ts>
+		static constexpr SignatureType group_signature_v = (SignatureType(0) | ... | (SignatureType(1) << component_index_v<Ts>));
+
+		template<class T>
+		struct Pool
+		{
+			// Packed, objects[k] belongs to entities[k].
+			std::vector<T> objects{};
+			std::vector<Index<StaticEverything>> entities{};
+
+			// Per entity, the position in objects plus one, 0 if it has no T.
+			std::vector<Index<Pool>> slots{ 0 };
+		};
+
+		std::vector<int32_t> validIndices{ false };
+		std::vector<SignatureType> signatures{ 0 };
+		std::vector<Index<StaticEverything>> freeIndices{};
+
+		std::tuple<Pool<Cs>...> pools{};
+
+		template<class T>
+		inline Pool<T>& pool();
+
+		template<class T>
+		inline Pool<T> const& pool() const;
+
+		inline Index<StaticEverything> make();
+
+		inline bool isValidIndex(Index<StaticEverything> i) const;
+
+		// Removes the entity with all its components, the index is reused.
+		inline void remove(Index<StaticEverything> i);
+
+		template<class T, class... Args>
+		inline T& add(Index<StaticEverything> i, Args&&... args);
+
+		template<class T>
+		inline void removeComponent(Index<StaticEverything> i);
+
+		template<class T>
+		inline T& get(Index<StaticEverything> i);
+
+		template<class T>
+		inline T const& get(Index<StaticEverything> i) const;
+
+		template<class... Ts>
+		inline bool has(Index<StaticEverything> i) const;
+
+		template<class T>
+		inline size_t size() const;
+
+		// Calls f for every entity that has all the components in the arguments of
+		// f, f can optionally take the Index<StaticEverything> of the entity as
+		// its first argument. The smallest pool is walked from the back, so f may
+		// remove components from the entity it is called for.
+		template<class F>
+		inline void match(F f);
+
+	private:
+		template<class F, class... Ts>
+		inline void matchExpanded(F& f, te::list_type<Ts...>);
+
+		template<bool object, class P, class F, class... Ts>
+		inline void loop(F& f, te::list_type<Ts...>);
+	};
+
+	template<class... Cs>
+	template<class T>
+	inline typename StaticEverything<Cs...>::template Pool<T>& StaticEverything<Cs...>::pool() {
+		return std::get<Pool<T>>(this->pools);
+	}
+
+	template<class... Cs>
+	template<class T>
+	inline typename StaticEverything<Cs...>::template Pool<T> const& StaticEverything<Cs...>::pool() const {
+		return std::get<Pool<T>>(this->pools);
+	}
+
+	template<class... Cs>
+	inline Index<StaticEverything<Cs...>> StaticEverything<Cs...>::make() {
+		if (!this->freeIndices.empty()) {
+			auto i = this->freeIndices.back();
+			this->freeIndices.pop_back();
+			this->validIndices[i] = true;
+			return i;
+		}
+
+		Index<StaticEverything> i;
+		i.set(this->signatures.size());
+		this->validIndices.push_back(true);
+		this->signatures.push_back(0);
+
+		std::apply([](auto&... pools) {
+			(pools.slots.push_back({ 0 }), ...);
+		}, this->pools);
+
+		return i;
+	}
+
+	template<class... Cs>
+	inline bool StaticEverything<Cs...>::isValidIndex(Index<StaticEverything> i) const {
+		return i != 0 && i < this->validIndices.size() && this->validIndices[i];
+	}
+
+	template<class... Cs>
+	inline void StaticEverything<Cs...>::remove(Index<StaticEverything> i) {
+		tassert(this->isValidIndex(i));
+
+		([&] {
+			if (this->has<Cs>(i)) {
+				this->removeComponent<Cs>(i);
+			}
+		}(), ...);
+
+		this->validIndices[i] = false;
+		this->freeIndices.push_back(i);
+	}
+
+	template<class... Cs>
+	template<class T, class... Args>
+	inline T& StaticEverything<Cs...>::add(Index<StaticEverything> i, Args&&... args) {
+		tassert(this->isValidIndex(i));
+		tassert(!this->has<T>(i));
+
+		auto& p = this->pool<T>();
+		p.objects.emplace_back(std::forward<Args>(args)...);
+		p.entities.push_back(i);
+		p.slots[i].set(p.objects.size());
+
+		this->signatures[i] |= group_signature_v<T>;
+
+		return p.objects.back();
+	}
+
+	template<class... Cs>
+	template<class T>
+	inline void StaticEverything<Cs...>::removeComponent(Index<StaticEverything> i) {
+		tassert(this->has<T>(i));
+
+		auto& p = this->pool<T>();
+		const size_t position = p.slots[i] - 1;
+
+		// Swap with the last object to keep the pool packed.
+		if (position + 1 != p.objects.size()) {
+			p.objects[position] = std::move(p.objects.back());
+			p.entities[position] = p.entities.back();
+			p.slots[p.entities[position]].set(position + 1);
+		}
+
+		p.objects.pop_back();
+		p.entities.pop_back();
+		p.slots[i].set(0);
+
+		this->signatures[i] &= ~group_signature_v<T>;
+	}
+
+	template<class... Cs>
+	template<class T>
+	inline T& StaticEverything<Cs...>::get(Index<StaticEverything> i) {
+		tassert(this->has<T>(i));
+		auto& p = this->pool<T>();
+		return p.objects[p.slots[i] - 1];
+	}
+
+	template<class... Cs>
+	template<class T>
+	inline T const& StaticEverything<Cs...>::get(Index<StaticEverything> i) const {
+		tassert(this->has<T>(i));
+		auto const& p = this->pool<T>();
+		return p.objects[p.slots[i] - 1];
+	}
+
+	template<class... Cs>
+	template<class... Ts>
+	inline bool StaticEverything<Cs...>::has(Index<StaticEverything> i) const {
+		constexpr auto signature = group_signature_v<Ts...>;
+		return (this->signatures[i] & signature) == signature;
+	}
+
+	template<class... Cs>
+	template<class T>
+	inline size_t StaticEverything<Cs...>::size() const {
+		return this->pool<T>().objects.size();
+	}
+
+	template<class... Cs>
+	template<class F>
+	inline void StaticEverything<Cs...>::match(F f) {
+		using arguments_list = te::map_t<
+			te::type_function_t<std::remove_cvref_t>,
+			te::arguments_list_t<F>
+		>;
+
+		this->matchExpanded(f, arguments_list{});
+	}
+
+	template<class... Cs>
+	template<class F, class... Ts>
+	inline void StaticEverything<Cs...>::matchExpanded(F& f, te::list_type<Ts...>) {
+		if constexpr (std::is_same_v<te::head_t<te::list_type<Ts...>>, Index<StaticEverything>>) {
+			using components = te::tail_t<te::list_type<Ts...>>;
+
+			[&]<class... Ms>(te::list_type<Ms...>) {
+				static_assert(sizeof...(Ms) != 0);
+
+				const std::array<size_t, sizeof...(Ms)> sizes{ this->size<Ms>()... };
+				const size_t pivot = std::ranges::min_element(sizes) - sizes.begin();
+
+				size_t k = 0;
+				((k++ == pivot ? this->loop<true, Ms>(f, components{}) : void()), ...);
+			}(components{});
+		}
+		else {
+			const std::array<size_t, sizeof...(Ts)> sizes{ this->size<Ts>()... };
+			const size_t pivot = std::ranges::min_element(sizes) - sizes.begin();
+
+			size_t k = 0;
+			((k++ == pivot ? this->loop<false, Ts>(f, te::list_type<Ts...>{}) : void()), ...);
+		}
+	}
+
+	template<class... Cs>
+	template<bool object, class P, class F, class... Ts>
+	inline void StaticEverything<Cs...>::loop(F& f, te::list_type<Ts...>) {
+		constexpr auto signature = group_signature_v<Ts...>;
+
+		auto& p = this->pool<P>();
+
+		for (size_t k = p.entities.size(); k-- > 0;) {
+			// f can have removed more than one object.
+			if (k >= p.entities.size()) {
+				continue;
+			}
+
+			auto i = p.entities[k];
+
+			if ((this->signatures[i] & signature) != signature) {
+				continue;
+			}
+
+			if constexpr (object) {
+				f(i, this->get<Ts>(i)...);
+			}
+			else {
+				f(this->get<Ts>(i)...);
+			}
+		}
+	}
+}
@@ -0,0 +1,119 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#include "Task.h"
+
+namespace mem
+{
+	void Executor::finish(Index<Task> id) {
+		std::coroutine_handle<Task::promise_type> handle{};
+
+		{
+			std::unique_lock lock(this->mutex);
+			auto it = this->tasks.find(id);
+			tassert(it != this->tasks.end());
+
+			handle = it->second.handle;
+			this->ready.insert(this->ready.end(), it->second.waiters.begin(), it->second.waiters.end());
+			this->tasks.erase(it);
+		}
+
+		// Suspended at its final suspend point.
+		handle.destroy();
+	}
+
+	void Executor::resume(std::coroutine_handle<> handle) {
+		Executor::resumedAt = clock::now();
+		handle.resume();
+	}
+
+	void Executor::schedule(std::coroutine_handle<> handle, bool nextFrame) {
+		std::unique_lock lock(this->mutex);
+
+		if (nextFrame) {
+			this->later.push_back(handle);
+		}
+		else {
+			this->ready.push_back(handle);
+		}
+	}
+
+	bool Executor::await(Index<Task> id, std::coroutine_handle<> handle) {
+		std::unique_lock lock(this->mutex);
+		auto it = this->tasks.find(id);
+
+		if (it == this->tasks.end()) {
+			return false;
+		}
+
+		it->second.waiters.push_back(handle);
+		return true;
+	}
+
+	Index<Task> Executor::spawn(Task task) {
+		auto handle = task.handle;
+		task.handle = {};
+
+		Index<Task> id{ 0 };
+
+		{
+			std::unique_lock lock(this->mutex);
+			id = this->nextId++;
+			this->tasks.insert({ id, { handle } });
+		}
+
+		handle.promise().executor = this;
+		handle.promise().id = id;
+
+		this->schedule(handle, false);
+
+		return id;
+	}
+
+	void Executor::run() {
+		this->runFrame([this](std::vector<std::coroutine_handle<>> const& batch) {
+			for (auto handle : batch) {
+				this->resume(handle);
+			}
+		});
+	}
+
+	void Executor::run(ThreadPool& pool) {
+		this->runFrame([&](std::vector<std::coroutine_handle<>> const& batch) {
+			const size_t workers = pool.size();
+			const size_t range = (batch.size() + workers - 1) / workers;
+
+			for (size_t begin = 0; begin < batch.size(); begin += range) {
+				const size_t end = std::min(begin + range, batch.size());
+
+				pool.submit([&, begin, end] {
+					for (size_t k = begin; k < end; k++) {
+						this->resume(batch[k]);
+					}
+				});
+			}
+
+			pool.wait();
+		});
+	}
+
+	bool Executor::isDone(Index<Task> id) {
+		std::unique_lock lock(this->mutex);
+		return !this->tasks.contains(id);
+	}
+
+	size_t Executor::size() {
+		std::unique_lock lock(this->mutex);
+		return this->tasks.size();
+	}
+
+	size_t Executor::getFrame() const {
+		return this->frame;
+	}
+
+	Executor::~Executor() {
+		for (auto& [id, entry] : this->tasks) {
+			entry.handle.destroy();
+		}
+	}
+}
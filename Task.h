@@ -0,0 +1,306 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#pragma once
+
+#include <coroutine>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <exception>
+
+#include "Index.h"
+#include "Everything.h"
+#include "ThreadPool.h"
+
+namespace mem
+{
+	struct Executor;
+
+	// A coroutine that is run by an Executor. Spawned tasks run until they
+	// finish, awaiting another Task runs it to completion inside the awaiting
+	// one.
+	struct Task
+	{
+		struct promise_type;
+
+		struct FinalAwaiter
+		{
+			inline bool await_ready() noexcept {
+				return false;
+			}
+
+			inline std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+
+			inline void await_resume() noexcept {
+			}
+		};
+
+		struct promise_type
+		{
+			// Resumed when an awaited task finishes.
+			std::coroutine_handle<> continuation{};
+
+			// Set for spawned tasks.
+			Executor* executor = nullptr;
+			Index<Task> id{ 0 };
+
+			inline Task get_return_object() {
+				return Task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+			}
+
+			// Tasks only start when spawned or awaited.
+			inline std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+
+			inline FinalAwaiter final_suspend() noexcept {
+				return {};
+			}
+
+			inline void return_void() {
+			}
+
+			inline void unhandled_exception() {
+				std::terminate();
+			}
+		};
+
+		struct Awaiter
+		{
+			std::coroutine_handle<promise_type> handle;
+
+			inline bool await_ready() {
+				return !this->handle || this->handle.done();
+			}
+
+			inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+				this->handle.promise().continuation = awaiting;
+				return this->handle;
+			}
+
+			inline void await_resume() {
+			}
+		};
+
+		std::coroutine_handle<promise_type> handle{};
+
+		inline Awaiter operator co_await() && {
+			return { this->handle };
+		}
+
+		inline explicit Task(std::coroutine_handle<promise_type> handle_) : handle(handle_) {
+		}
+
+		inline Task(Task&& other) noexcept : handle(other.handle) {
+			other.handle = {};
+		}
+
+		inline Task& operator=(Task&& other) noexcept {
+			if (this->handle) {
+				this->handle.destroy();
+			}
+			this->handle = other.handle;
+			other.handle = {};
+			return *this;
+		}
+
+		inline ~Task() {
+			if (this->handle) {
+				this->handle.destroy();
+			}
+		}
+
+		NO_COPY(Task);
+	};
+
+	// Runs spawned tasks a frame at a time. Suspended tasks only keep their
+	// coroutine frame, so thousands of them can share the threads of a pool.
+	struct Executor
+	{
+		using clock = std::chrono::steady_clock;
+
+	private:
+		struct Entry
+		{
+			std::coroutine_handle<Task::promise_type> handle{};
+			// Resumed when the task finishes.
+			std::vector<std::coroutine_handle<>> waiters{};
+		};
+
+		std::mutex mutex{};
+
+		// The tasks that have not finished, by id. Ids are not reused, so a task
+		// that is not here has finished.
+		std::unordered_map<Index<Task>, Entry> tasks{};
+		Index<Task> nextId{ 1 };
+
+		// Resumed in the running frame, and in the next one.
+		std::vector<std::coroutine_handle<>> ready{};
+		std::vector<std::coroutine_handle<>> later{};
+
+		size_t frame = 0;
+
+		// When the task running on this thread was resumed.
+		static inline thread_local clock::time_point resumedAt{};
+
+		friend Task::FinalAwaiter;
+
+		void finish(Index<Task> id);
+		void resume(std::coroutine_handle<> handle);
+		void schedule(std::coroutine_handle<> handle, bool nextFrame);
+		bool await(Index<Task> id, std::coroutine_handle<> handle);
+
+		template<class R>
+		inline void runFrame(R run);
+
+	public:
+		struct NextFrame
+		{
+			Executor& executor;
+
+			inline bool await_ready() {
+				return false;
+			}
+
+			inline void await_suspend(std::coroutine_handle<> handle) {
+				this->executor.schedule(handle, true);
+			}
+
+			inline void await_resume() {
+			}
+		};
+
+		struct Completion
+		{
+			Executor& executor;
+			Index<Task> id;
+
+			inline bool await_ready() {
+				return false;
+			}
+
+			// Does not suspend when the task has finished already.
+			inline bool await_suspend(std::coroutine_handle<> handle) {
+				return this->executor.await(this->id, handle);
+			}
+
+			inline void await_resume() {
+			}
+		};
+
+		struct YieldAfter
+		{
+			Executor& executor;
+			std::chrono::microseconds limit;
+
+			inline bool await_ready() {
+				return std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - Executor::resumedAt) < this->limit;
+			}
+
+			inline void await_suspend(std::coroutine_handle<> handle) {
+				this->executor.schedule(handle, true);
+			}
+
+			inline void await_resume() {
+			}
+		};
+
+		// Starts task in the running frame, or in the next one when called
+		// outside of run.
+		Index<Task> spawn(Task task);
+
+		// co_await to continue in the next frame.
+		inline NextFrame nextFrame();
+
+		// co_await to continue once the spawned task id has finished.
+		inline Completion completion(Index<Task> id);
+
+		// co_await to continue in the next frame only when the task has run for
+		// longer than limit since it was last resumed.
+		inline YieldAfter yieldAfter(std::chrono::microseconds limit);
+
+		// Runs a frame on this thread, every task that is ready runs until it
+		// suspends. Tasks resumed by tasks finishing in the frame run in it too.
+		void run();
+
+		// Runs a frame with the ready tasks spread over the workers of pool.
+		// Tasks running at the same time must not touch the same world.
+		void run(ThreadPool& pool);
+
+		bool isDone(Index<Task> id);
+
+		// Tasks spawned and not finished.
+		size_t size();
+
+		size_t getFrame() const;
+
+		Executor() = default;
+		~Executor();
+
+		NO_COPY_MOVE(Executor);
+	};
+
+	// Spreads one pass of e.match(f) over as many frames as the budget per
+	// frame needs, the frames between calls can change the world freely.
+	template<class F>
+	inline Task matchOverFrames(Executor& executor, Everything& e, QueryBudget budget, F f) {
+		QueryCursor cursor{};
+
+		while (!e.match(cursor, budget, f)) {
+			co_await executor.nextFrame();
+		}
+	}
+
+	inline std::coroutine_handle<> Task::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+		auto& promise = handle.promise();
+
+		if (promise.continuation) {
+			return promise.continuation;
+		}
+
+		if (promise.executor != nullptr) {
+			promise.executor->finish(promise.id);
+		}
+
+		return std::noop_coroutine();
+	}
+
+	inline Executor::NextFrame Executor::nextFrame() {
+		return { *this };
+	}
+
+	inline Executor::Completion Executor::completion(Index<Task> id) {
+		return { *this, id };
+	}
+
+	inline Executor::YieldAfter Executor::yieldAfter(std::chrono::microseconds limit) {
+		return { *this, limit };
+	}
+
+	template<class R>
+	inline void Executor::runFrame(R run) {
+		{
+			std::unique_lock lock(this->mutex);
+			this->frame++;
+			this->ready.insert(this->ready.end(), this->later.begin(), this->later.end());
+			this->later.clear();
+		}
+
+		while (true) {
+			std::vector<std::coroutine_handle<>> batch;
+
+			{
+				std::unique_lock lock(this->mutex);
+				std::swap(batch, this->ready);
+			}
+
+			if (batch.empty()) {
+				return;
+			}
+
+			run(batch);
+		}
+	}
+}
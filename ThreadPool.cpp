@@ -0,0 +1,96 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#include "ThreadPool.h"
+
+namespace mem
+{
+	void ThreadPool::work(size_t worker) {
+		auto& own = this->own[worker];
+
+		while (true) {
+			std::function<void()> task;
+
+			{
+				std::unique_lock lock(this->mutex);
+				this->available.wait(lock, [&] {
+					return this->stopping || !own.empty() || !this->tasks.empty();
+				});
+
+				if (!own.empty()) {
+					task = std::move(own.front());
+					own.pop_front();
+				}
+				else if (!this->tasks.empty()) {
+					task = std::move(this->tasks.front());
+					this->tasks.pop_front();
+				}
+				else {
+					return;
+				}
+			}
+
+			task();
+
+			{
+				std::unique_lock lock(this->mutex);
+				if (--this->pending == 0) {
+					this->idle.notify_all();
+				}
+			}
+		}
+	}
+
+	size_t ThreadPool::size() const {
+		return this->workers.size();
+	}
+
+	void ThreadPool::submit(std::function<void()> task) {
+		{
+			std::unique_lock lock(this->mutex);
+			this->tasks.push_back(std::move(task));
+			this->pending++;
+		}
+
+		this->available.notify_one();
+	}
+
+	void ThreadPool::submit(size_t worker, std::function<void()> task) {
+		{
+			std::unique_lock lock(this->mutex);
+			this->own[worker].push_back(std::move(task));
+			this->pending++;
+		}
+
+		// Any worker could be woken by notify_one.
+		this->available.notify_all();
+	}
+
+	void ThreadPool::wait() {
+		std::unique_lock lock(this->mutex);
+		this->idle.wait(lock, [this] {
+			return this->pending == 0;
+		});
+	}
+
+	ThreadPool::ThreadPool(size_t threads) :
+		own(threads) {
+		for (size_t i = 0; i < threads; i++) {
+			this->workers.emplace_back([this, i] {
+				this->work(i);
+			});
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::unique_lock lock(this->mutex);
+			this->stopping = true;
+		}
+
+		this->available.notify_all();
+
+		// Joined here, the workers still use the members declared after them.
+		this->workers.clear();
+	}
+}
@@ -0,0 +1,57 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "Macros.h"
+
+namespace mem
+{
+	// Fixed set of worker threads taking tasks from a shared queue.
+	struct ThreadPool
+	{
+	private:
+		std::vector<std::jthread> workers{};
+
+		std::mutex mutex{};
+		std::condition_variable available{};
+		std::condition_variable idle{};
+
+		std::deque<std::function<void()>> tasks{};
+		// Per worker, tasks only that worker takes. They go before the shared
+		// queue.
+		std::vector<std::deque<std::function<void()>>> own{};
+		// Tasks queued or running.
+		size_t pending = 0;
+		bool stopping = false;
+
+		void work(size_t worker);
+
+	public:
+		size_t size() const;
+
+		// Tasks are allowed to submit more tasks.
+		void submit(std::function<void()> task);
+
+		// Runs task on the given worker, for work that should stay on the same
+		// thread from one submission to the next.
+		void submit(size_t worker, std::function<void()> task);
+
+		// Blocks until every submitted task, including the ones submitted by
+		// other tasks in the meantime, has finished.
+		void wait();
+
+		ThreadPool(size_t threads = std::max(1u, std::thread::hardware_concurrency()));
+		~ThreadPool();
+
+		NO_COPY_MOVE(ThreadPool);
+	};
+}
@@ -0,0 +1,4 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#include "WorldBatch.h"
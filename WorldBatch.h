@@ -0,0 +1,182 @@
+// mem - A C++ library for managing objects
+// Copyright (C) 2021 intrets
+
+#pragma once
+
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <algorithm>
+
+#include "Everything.h"
+#include "ThreadPool.h"
+
+namespace mem
+{
+	// Many small independent worlds run by the same systems. The worlds are
+	// split in fixed ranges, one per worker of the pool, so a world stays on
+	// the same thread from one run to the next. Query plans are made once per
+	// shape, the component types present plus the owning groups, and copied
+	// to the other worlds of that shape.
+	struct WorldBatch
+	{
+	private:
+		std::vector<Everything> worlds{};
+
+		struct Shape
+		{
+			SignatureType components{};
+			std::vector<SignatureType> groups{};
+
+			inline bool operator==(Shape const& other) const = default;
+		};
+
+		inline static Shape getShape(Everything const& world);
+
+		// Per world, the position of its shape in the list of shapes.
+		inline std::vector<size_t> classify(std::vector<size_t>& representatives) const;
+
+		// Calls f(size_t k) for every world k, the worlds of one range on one
+		// worker.
+		template<class F>
+		inline void runRanges(ThreadPool& pool, F& f);
+
+	public:
+		inline Everything& add(Everything&& world);
+		inline Everything& make();
+
+		inline Everything& get(size_t k);
+		inline std::span<Everything> getWorlds();
+		inline size_t size() const;
+
+		// Calls f(Everything&) for every world, in parallel on the workers of
+		// pool. f may change the structure of the world it gets.
+		template<class F>
+		inline void forEach(ThreadPool& pool, F f);
+
+		// Runs world.match(f) on every world, planning once for each shape.
+		template<class F>
+		inline void match(ThreadPool& pool, F f);
+
+		WorldBatch() = default;
+		~WorldBatch() = default;
+
+		NO_COPY(WorldBatch);
+		DEFAULT_MOVE(WorldBatch);
+	};
+
+	inline WorldBatch::Shape WorldBatch::getShape(Everything const& world) {
+		Shape res{};
+
+		for (size_t type = 0; type < SIZE; type++) {
+			if (world.counts[type] != 0) {
+				res.components.set(type);
+			}
+		}
+
+		for (Index<OwningGroup> group{ 1 }; group < world.groups.size(); group++) {
+			res.groups.push_back(world.groups[group].signature);
+		}
+
+		return res;
+	}
+
+	inline std::vector<size_t> WorldBatch::classify(std::vector<size_t>& representatives) const {
+		std::vector<size_t> res(this->worlds.size());
+
+		// Shapes by their components, the groups rarely differ.
+		std::unordered_map<SignatureType, std::vector<std::pair<Shape, size_t>>> shapes{};
+
+		for (size_t k = 0; k < this->worlds.size(); k++) {
+			auto shape = getShape(this->worlds[k]);
+			auto& candidates = shapes[shape.components];
+
+			auto it = std::ranges::find_if(candidates, [&](auto const& candidate) {
+				return candidate.first == shape;
+			});
+
+			if (it != candidates.end()) {
+				res[k] = it->second;
+			}
+			else {
+				res[k] = representatives.size();
+				representatives.push_back(k);
+				candidates.push_back({ std::move(shape), res[k] });
+			}
+		}
+
+		return res;
+	}
+
+	inline Everything& WorldBatch::add(Everything&& world) {
+		return this->worlds.emplace_back(std::move(world));
+	}
+
+	inline Everything& WorldBatch::make() {
+		return this->worlds.emplace_back();
+	}
+
+	inline Everything& WorldBatch::get(size_t k) {
+		return this->worlds[k];
+	}
+
+	inline std::span<Everything> WorldBatch::getWorlds() {
+		return this->worlds;
+	}
+
+	inline size_t WorldBatch::size() const {
+		return this->worlds.size();
+	}
+
+	template<class F>
+	inline void WorldBatch::runRanges(ThreadPool& pool, F& f) {
+		const size_t workers = pool.size();
+		const size_t range = (this->worlds.size() + workers - 1) / workers;
+
+		for (size_t worker = 0; worker < workers; worker++) {
+			const size_t begin = worker * range;
+			const size_t end = std::min(begin + range, this->worlds.size());
+
+			if (begin >= end) {
+				break;
+			}
+
+			pool.submit(worker, [&, begin, end] {
+				for (size_t k = begin; k < end; k++) {
+					f(k);
+				}
+			});
+		}
+
+		pool.wait();
+	}
+
+	template<class F>
+	inline void WorldBatch::forEach(ThreadPool& pool, F f) {
+		auto run = [&](size_t k) {
+			f(this->worlds[k]);
+		};
+
+		this->runRanges(pool, run);
+	}
+
+	template<class F>
+	inline void WorldBatch::match(ThreadPool& pool, F f) {
+		std::vector<size_t> representatives{};
+		auto shapes = this->classify(representatives);
+
+		// Copied, the representatives can replace their plans while they run.
+		std::vector<QueryPlan> plans{};
+		plans.reserve(representatives.size());
+		for (auto k : representatives) {
+			plans.push_back(this->worlds[k].template preparePlan<F>());
+		}
+
+		auto run = [&](size_t k) {
+			this->worlds[k].template adoptPlan<F>(plans[shapes[k]]);
+			this->worlds[k].match(f);
+		};
+
+		this->runRanges(pool, run);
+	}
+}